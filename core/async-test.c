@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "lemon_corn_async.h"
+#include "PC-OP-RS1.h"
+
+#define TEST_N_THREADS		4
+#define TEST_N_REQS		8
+#define TEST_PENDING_MS		300	/* a receive is still waiting */
+#define TEST_CANCEL_MS		1000	/* a canceled one is done */
+
+static struct lcasync as;
+static unsigned char sig[16];
+
+/* the order of the completions.  written on the I/O thread only */
+static int done_log[TEST_N_THREADS * TEST_N_REQS];
+static int n_done_log;
+
+static void log_done(struct lcasync_req *req)
+{
+	done_log[n_done_log++] = (int)(intptr_t)req->priv;
+}
+
+static void *submitter(void *arg)
+{
+	struct lcasync_req *reqs = arg;
+	int i;
+
+	for (i = 0; i < TEST_N_REQS; i++)
+		lcasync_submit(&as, &reqs[i]);
+	return NULL;
+}
+
+/*
+ * every thread's requests complete in the order submitted
+ */
+static int test_order(void)
+{
+	static struct lcasync_req reqs[TEST_N_THREADS][TEST_N_REQS];
+	int last[TEST_N_THREADS];
+	pthread_t th[TEST_N_THREADS];
+	struct lcdev dev;
+	int t, i;
+	int r = 0;
+
+	lcdev_init(&dev);
+	dev.is_virtual = 1;
+	if (lcasync_start(&as, &dev) < 0)
+		return -1;
+
+	for (t = 0; t < TEST_N_THREADS; t++) {
+		last[t] = -1;
+		for (i = 0; i < TEST_N_REQS; i++) {
+			reqs[t][i].op = LCASYNC_OP_TRANSMIT;
+			reqs[t][i].ch = 1;
+			reqs[t][i].data = sig;
+			reqs[t][i].sz = sizeof(sig);
+			reqs[t][i].done = log_done;
+			reqs[t][i].priv = (void *)(intptr_t)
+					  (t * TEST_N_REQS + i);
+		}
+		pthread_create(&th[t], NULL, submitter, reqs[t]);
+	}
+	for (t = 0; t < TEST_N_THREADS; t++)
+		pthread_join(th[t], NULL);
+	/* the queued ones are serviced before the stop */
+	lcasync_stop(&as);
+
+	if (n_done_log != TEST_N_THREADS * TEST_N_REQS) {
+		printf("order: %d of %d done\n",
+		       n_done_log, TEST_N_THREADS * TEST_N_REQS);
+		return -1;
+	}
+	for (i = 0; i < n_done_log; i++) {
+		t = done_log[i] / TEST_N_REQS;
+		if (done_log[i] % TEST_N_REQS != last[t] + 1) {
+			printf("order: #%d of thread %d after #%d\n",
+			       done_log[i] % TEST_N_REQS, t, last[t]);
+			r = -1;
+		}
+		last[t] = done_log[i] % TEST_N_REQS;
+	}
+	for (t = 0; t < TEST_N_THREADS; t++)
+		for (i = 0; i < TEST_N_REQS; i++)
+			if (!lcasync_req_is_done(&reqs[t][i]) ||
+			    reqs[t][i].result) {
+				printf("order: #%d of thread %d failed\n",
+				       i, t);
+				r = -1;
+			}
+	if (r == 0)
+		printf("order: OK\n");
+	return r;
+}
+
+/*
+ * a device which accepts the receive and the resync, but never sees a
+ * signal
+ */
+static int dev_fd;
+
+static void *device(void *arg)
+{
+	unsigned char c;
+
+	(void)arg;
+	while (read(dev_fd, &c, 1) == 1) {
+		if (c == PCOPRS1_CMD_RECEIVE)
+			c = PCOPRS1_CMD_OK;
+		else if (c == PCOPRS1_CMD_LED)
+			c = PCOPRS1_CMD_LED_OK;
+		else
+			continue;
+		if (write(dev_fd, &c, 1) != 1)
+			break;
+	}
+	return NULL;
+}
+
+static int wait_done(const struct lcasync_req *req, int timeout_ms)
+{
+	for (; timeout_ms > 0; timeout_ms -= 10) {
+		if (lcasync_req_is_done(req))
+			return 0;
+		usleep(10 * 1000);
+	}
+	return lcasync_req_is_done(req) ? 0 : -1;
+}
+
+static int test_cancel(void)
+{
+	struct lcasync_req req[2];
+	unsigned char buf[2][PCOPRS1_DATA_LEN];
+	struct lcdev dev;
+	pthread_t th;
+	int sv[2];
+	int i;
+	int r = -1;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		return -1;
+	lcdev_init(&dev);
+	dev.fd = sv[0];
+	dev.is_proxy = 1;
+	dev_fd = sv[1];
+	pthread_create(&th, NULL, device, NULL);
+	if (lcasync_start(&as, &dev) < 0)
+		goto out;
+
+	/* nothing to cancel yet */
+	lcasync_cancel(&as);
+
+	memset(req, 0, sizeof(req));
+	for (i = 0; i < 2; i++) {
+		req[i].op = LCASYNC_OP_RECEIVE;
+		req[i].data = buf[i];
+		req[i].sz = sizeof(buf[i]);
+		lcasync_submit(&as, &req[i]);
+	}
+	usleep(TEST_PENDING_MS * 1000);
+	if (lcasync_req_is_done(&req[0])) {
+		printf("cancel: canceled while idle\n");
+		goto stop;
+	}
+
+	/* only the one in progress is canceled */
+	lcasync_cancel(&as);
+	if ((wait_done(&req[0], TEST_CANCEL_MS) < 0) ||
+	    (req[0].result >= 0)) {
+		printf("cancel: the receive in progress isn't canceled\n");
+		goto stop;
+	}
+	usleep(TEST_PENDING_MS * 1000);
+	if (lcasync_req_is_done(&req[1])) {
+		printf("cancel: the queued receive is canceled too\n");
+		goto stop;
+	}
+	r = 0;
+
+stop:
+	lcasync_cancel(&as);
+	if (wait_done(&req[1], TEST_CANCEL_MS) < 0) {
+		printf("cancel: the queued receive isn't canceled\n");
+		r = -1;
+	}
+	lcasync_stop(&as);
+	if (r == 0)
+		printf("cancel: OK\n");
+out:
+	shutdown(sv[0], SHUT_RDWR);
+	pthread_join(th, NULL);
+	close(sv[0]);
+	close(sv[1]);
+	return r;
+}
+
+int main(void)
+{
+	int failed = 0;
+
+	if (test_order() < 0)
+		failed++;
+	if (test_cancel() < 0)
+		failed++;
+
+	return failed ? 1 : 0;
+}
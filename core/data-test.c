@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "lemon_corn_data.h"
+
+#define TEST_TAG		"a"
+#define TEST_DATA_LEN		32
+#define TEST_REPEAT		3
+
+static size_t put_ent(void *p, const char *tag, unsigned char val,
+		      size_t len)
+{
+	struct lcdata_ent_img_var *vent = p;
+	struct lcdata_ent_img_fxd *fent = p;
+	char *dst_tag;
+	unsigned char *dst_data;
+
+	if (len == PCOPRS1_DATA_LEN) {
+		dst_tag = fent->tag;
+		dst_data = fent->data;
+	} else {
+		lcdata_ent_img_var_initialize(vent, len);
+		dst_tag = vent->tag;
+		dst_data = vent->data;
+	}
+	memset(dst_tag, 0, LEMON_CORN_TAG_LEN);
+	strcpy(dst_tag, tag);
+	memset(dst_data, val, len);
+	return dst_data + len - (unsigned char *)p;
+}
+
+static int count_valid(struct lcdata *lcdata, const char *tag)
+{
+	struct lcdata_ent ent;
+	void *p, *nextp, *endp;
+	int n = 0;
+
+	lcdata_for_each_entry(lcdata, &ent, p, nextp, endp) {
+		if (lcdata_ent_img_is_valid(p) && !strcmp(tag, ent.tag))
+			n++;
+	}
+	return n;
+}
+
+static int check(struct lcdata *lcdata, const char *what)
+{
+	struct lcdata_ent ent;
+	int n;
+
+	if ((n = count_valid(lcdata, TEST_TAG)) != 1) {
+		printf("%s: %d entries of %s\n", what, n, TEST_TAG);
+		return -1;
+	}
+	if (lcdata_get_cmd_by_tag(lcdata, TEST_TAG, &ent) < 0) {
+		printf("%s: %s not found\n", what, TEST_TAG);
+		return -1;
+	}
+	if (ent.data[0] != TEST_REPEAT) {
+		printf("%s: got #%d of %s, expected the last one\n",
+		       what, ent.data[0], TEST_TAG);
+		return -1;
+	}
+	if (lcdata_get_cmd_by_tag(lcdata, "b", &ent) < 0) {
+		printf("%s: b lost\n", what);
+		return -1;
+	}
+	printf("%s: OK\n", what);
+	return 0;
+}
+
+/*
+ * the same tag repeated as in a -forge_bulk stream.  the last one wins.
+ * the invalidated variable size entries keep the tag.
+ */
+int main(void)
+{
+	struct lcdata lcdata = { .img_size = 0, .ent_img = NULL, .idx = NULL };
+	char fn[] = "/tmp/data-test.XXXXXX";
+	int failed = 0;
+	int fd;
+	int i;
+
+	lcdata.ent_img = malloc((sizeof(struct lcdata_ent_img_var) +
+				 PCOPRS1_DATA_LEN) * (TEST_REPEAT + 1));
+	if (lcdata.ent_img == NULL) {
+		printf("memory allocation failed.\n");
+		return 1;
+	}
+	lcdata.img_size += put_ent(lcdata.ent_img, "b", 0, PCOPRS1_DATA_LEN);
+	for (i = 1; i <= TEST_REPEAT; i++) {
+		lcdata_delete_by_tag(&lcdata, TEST_TAG);
+		lcdata.img_size += put_ent(lcdata.ent_img + lcdata.img_size,
+					   TEST_TAG, i, TEST_DATA_LEN);
+	}
+	if (check(&lcdata, "in memory") < 0)
+		failed++;
+	/* the invalidated entries are in the index too */
+	if ((lcdata_index(&lcdata) < 0) || (check(&lcdata, "indexed") < 0))
+		failed++;
+
+	/* only the valid entries are saved */
+	if ((fd = mkstemp(fn)) < 0) {
+		printf("can't create %s\n", fn);
+		failed++;
+	} else {
+		close(fd);
+		lcdata_save(&lcdata, fn);
+		lcdata_free(&lcdata);
+		if (lcdata_load(&lcdata, fn) < 0) {
+			printf("can't load %s\n", fn);
+			failed++;
+		} else if (check(&lcdata, "saved") < 0) {
+			failed++;
+		} else if (lcdata_index(&lcdata) < 0) {
+			failed++;
+		} else {
+			struct lcdata_ent ent;
+
+			/* deleted through the index */
+			lcdata_delete_by_tag(&lcdata, TEST_TAG);
+			if (!lcdata_get_cmd_by_tag(&lcdata, TEST_TAG, &ent)) {
+				printf("deleted: %s still found\n", TEST_TAG);
+				failed++;
+			}
+		}
+		unlink(fn);
+	}
+	lcdata_free(&lcdata);
+
+	return failed ? 1 : 0;
+}
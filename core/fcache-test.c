@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "lemon_corn_fcache.h"
+
+#define TEST_SIZE		4
+#define TEST_CUSTOM		0x1234ULL
+
+static void forge(unsigned char *data, size_t *sz, unsigned long long cmd)
+{
+	*sz = 8 + cmd;
+	memset(data, (int)cmd, *sz);
+}
+
+static int insert(struct lcfcache *fc, const char *fmt,
+		  unsigned long long cmd)
+{
+	unsigned char data[64];
+	size_t sz;
+
+	forge(data, &sz, cmd);
+	return lcfcache_insert(fc, fmt, TEST_CUSTOM, cmd, data, sz);
+}
+
+/*
+ * the commands from the most recently used one, like "5 1 4 3"
+ */
+static const char *lru_order(const struct lcfcache *fc, char *s)
+{
+	int id;
+
+	*s = '\0';
+	for (id = fc->head; id >= 0; id = fc->ents[id].next)
+		sprintf(s + strlen(s), "%s%llu", *s ? " " : "",
+			fc->ents[id].cmd);
+	return s;
+}
+
+static int check_order(const struct lcfcache *fc, const char *what,
+		       const char *expected)
+{
+	char s[64];
+
+	if (strcmp(lru_order(fc, s), expected)) {
+		printf("%s: order \"%s\", expected \"%s\"\n",
+		       what, s, expected);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * @cmd is cached with its data.  this makes it the most recently used.
+ */
+static int check_cached(struct lcfcache *fc, const char *what,
+			unsigned long long cmd)
+{
+	const struct lcfcache_ent *ent;
+	unsigned char data[64];
+	size_t sz;
+
+	forge(data, &sz, cmd);
+	ent = lcfcache_lookup(fc, "NEC", TEST_CUSTOM, cmd);
+	if (ent == NULL) {
+		printf("%s: %llu not cached\n", what, cmd);
+		return -1;
+	}
+	if ((ent->data_size != sz) || memcmp(ent->data, data, sz)) {
+		printf("%s: %llu has wrong data\n", what, cmd);
+		return -1;
+	}
+	return 0;
+}
+
+static int test_lru(struct lcfcache *fc)
+{
+	int cmd;
+
+	for (cmd = 1; cmd <= TEST_SIZE; cmd++)
+		insert(fc, "NEC", cmd);
+	if (check_order(fc, "insert", "4 3 2 1") < 0)
+		return -1;
+
+	/* a lookup and a second insert make it the most recent */
+	if ((check_cached(fc, "lookup", 1) < 0) ||
+	    (check_order(fc, "lookup", "1 4 3 2") < 0))
+		return -1;
+	insert(fc, "NEC", 3);
+	if ((fc->n_ent != TEST_SIZE) ||
+	    (check_order(fc, "insert again", "3 1 4 2") < 0))
+		return -1;
+
+	/* the least recently used one goes */
+	insert(fc, "NEC", 5);
+	if (lcfcache_lookup(fc, "NEC", TEST_CUSTOM, 2)) {
+		printf("evict: 2 still cached\n");
+		return -1;
+	}
+	if (check_order(fc, "evict", "5 3 1 4") < 0)
+		return -1;
+
+	/* the format is a part of the key */
+	if (lcfcache_lookup(fc, "AEHA", TEST_CUSTOM, 5)) {
+		printf("key: AEHA 5 found\n");
+		return -1;
+	}
+	printf("lru: OK\n");
+	return 0;
+}
+
+static int test_file(const struct lcfcache *fc)
+{
+	struct lcfcache fc2;
+	char fn[] = "/tmp/fcache-test.XXXXXX";
+	int fd;
+	int r = -1;
+
+	if ((fd = mkstemp(fn)) < 0) {
+		printf("can't create %s\n", fn);
+		return -1;
+	}
+	close(fd);
+	if (lcfcache_save(fc, fn) < 0) {
+		printf("file: not saved\n");
+		goto out;
+	}
+
+	/* the same entries in the same order */
+	if (lcfcache_init(&fc2, TEST_SIZE) < 0)
+		goto out;
+	if ((lcfcache_load(&fc2, fn) < 0) || fc2.is_dirty ||
+	    (check_order(&fc2, "load", "5 3 1 4") < 0)) {
+		lcfcache_free(&fc2);
+		goto out;
+	}
+	if ((check_cached(&fc2, "load", 4) < 0) ||
+	    (check_cached(&fc2, "load", 5) < 0)) {
+		lcfcache_free(&fc2);
+		goto out;
+	}
+	lcfcache_free(&fc2);
+
+	/* a smaller cache keeps the most recent ones */
+	if (lcfcache_init(&fc2, 2) < 0)
+		goto out;
+	if ((lcfcache_load(&fc2, fn) < 0) ||
+	    (check_order(&fc2, "load to 2", "5 3") < 0)) {
+		lcfcache_free(&fc2);
+		goto out;
+	}
+	lcfcache_free(&fc2);
+
+	printf("file: OK\n");
+	r = 0;
+out:
+	unlink(fn);
+	return r;
+}
+
+int main(void)
+{
+	struct lcfcache fc;
+	int failed = 0;
+
+	if (lcfcache_init(&fc, TEST_SIZE) < 0)
+		return 1;
+	if (test_lru(&fc) < 0)
+		failed++;
+	else if (test_file(&fc) < 0)
+		failed++;
+	lcfcache_free(&fc);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "format/remocon_format.h"
+
+#define GUARD			0x5a
+#define GUARD_LEN		64
+
+/*
+ * short pulse distance patterns, so that the decoded text is longer than
+ * the (sz * 2 + 1) bytes the callers give
+ */
+static struct format_test {
+	const char *name;
+	size_t sz;		/* bytes of the pattern */
+	int n_bits;
+	const char *fmt_tag;
+} format_test[] = {
+	{ .name = "PDM  8 bits", .sz = 16, .n_bits =  8, .fmt_tag = "PDM" },
+	{ .name = "PDM 16 bits", .sz = 32, .n_bits = 16, .fmt_tag = "PDM" },
+};
+
+static void put_level(unsigned char *ptn, int *idx, int level, int len)
+{
+	for (; len > 0; len--, (*idx)++)
+		if (level)
+			ptn[*idx / 8] |= 1 << (*idx % 8);
+}
+
+/*
+ * HIGH 200us, LOW 200us (0) / 600us (1), then the stop bit
+ */
+static void forge_pdm(unsigned char *ptn, int n_bits)
+{
+	int idx = 0;
+	int i;
+
+	for (i = 0; i < n_bits; i++) {
+		put_level(ptn, &idx, 1, 2);
+		put_level(ptn, &idx, 0, (i & 1) ? 6 : 2);
+	}
+	put_level(ptn, &idx, 1, 2);
+}
+
+static int run_test(const struct format_test *t)
+{
+	size_t dst_len = t->sz * 2 + 1;
+	unsigned char *ptn;
+	char *dst_str;
+	char fmt_tag[32];
+	size_t i;
+	int r = -1;
+
+	ptn = calloc(1, t->sz);
+	dst_str = malloc(dst_len + GUARD_LEN);
+	if ((ptn == NULL) || (dst_str == NULL)) {
+		printf("%s: memory allocation failed.\n", t->name);
+		goto out;
+	}
+	forge_pdm(ptn, t->n_bits);
+	memset(dst_str, GUARD, dst_len + GUARD_LEN);
+
+	if (remocon_format_analyze(fmt_tag, dst_str, dst_len, ptn, t->sz,
+				   NULL) < 0) {
+		printf("%s: not analyzed\n", t->name);
+		goto out;
+	}
+	if (strcmp(fmt_tag, t->fmt_tag)) {
+		printf("%s: format %s, expected %s\n",
+		       t->name, fmt_tag, t->fmt_tag);
+		goto out;
+	}
+	if (strnlen(dst_str, dst_len) == dst_len) {
+		printf("%s: not terminated\n", t->name);
+		goto out;
+	}
+	for (i = dst_len; i < dst_len + GUARD_LEN; i++) {
+		if ((unsigned char)dst_str[i] != GUARD) {
+			printf("%s: overrun at %zu of %zu\n",
+			       t->name, i, dst_len);
+			goto out;
+		}
+	}
+	printf("%s: OK (%s)\n", t->name, dst_str);
+	r = 0;
+
+out:
+	free(ptn);
+	free(dst_str);
+	return r;
+}
+
+int main(void)
+{
+	unsigned int i;
+	int failed = 0;
+
+	for (i = 0; i < sizeof(format_test) / sizeof(format_test[0]); i++)
+		if (run_test(&format_test[i]) < 0)
+			failed++;
+
+	return failed ? 1 : 0;
+}
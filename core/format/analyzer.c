@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <assert.h>
 #include "../string_util.h"
 
@@ -31,6 +32,9 @@
 
 #define ARRAY_SIZE(a)	(sizeof(a) / sizeof(a[0]))
 
+static struct analyzer_table analyzer_table[] = ANALYZER_TABLE;
+static struct analyzer_stats generic_stats;	/* fallback decoder */
+
 /*
  * analyzer functions
  */
@@ -87,6 +91,14 @@ static inline int analyzer_try_detect_trailer(const analyzer_t *azer)
 	return 0;
 }
 
+static inline int analyzer_reject_reason(const analyzer_t *azer)
+{
+	if ((azer->state == ANALYZER_STATE_LEADER) ||
+	    (azer->state == ANALYZER_STATE_TRAILER))
+		return ANALYZER_REJECT_LEADER;
+	return ANALYZER_REJECT_DATA;
+}
+
 static int analyzer_on_each_sample(const analyzer_t *azer)
 {
 	int r;
@@ -99,25 +111,71 @@ static int analyzer_on_each_sample(const analyzer_t *azer)
 	return r;
 }
 
+/*
+ * identical data cycles from the first one
+ */
+#define ANALYZER_REP_JITTER	3	/* in samples */
+
+struct analyzer_rep {
+	unsigned char buf[ANALYZER_DATA_LEN_MAX];
+	int bits;
+	int start, last, period;	/* in samples */
+	int count;
+};
+
+static void analyzer_rep_on_end_cycle(struct analyzer_rep *rep,
+				      const analyzer_t *azer,
+				      const unsigned char *buf, int cycle_start)
+{
+	int period = cycle_start - rep->last;
+
+	if (azer->cycle == 0) {
+		memcpy(rep->buf, buf, sizeof(rep->buf));
+		rep->bits = azer->dst_idx;
+		rep->start = rep->last = cycle_start;
+		rep->count = 1;
+		return;
+	}
+	if ((rep->count != azer->cycle) || (rep->bits != azer->dst_idx) ||
+	    memcmp(rep->buf, buf, sizeof(rep->buf)))
+		return;
+	if (rep->count == 1)
+		rep->period = period;
+	else if (abs(period - rep->period) > ANALYZER_REP_JITTER)
+		return;
+	rep->last = cycle_start;
+	rep->count++;
+}
+
 /*
  * generic analyzer func
+ * on failure, returns -1 and sets the reason to @reject
  */
 static int
 analyze(struct analyzer_config *azer_cfg, struct analyzer_ops *azer_ops,
-	char *fmt_tag, char *dst_str, const unsigned char *ptn, size_t sz)
+	char *fmt_tag, char *dst_str, size_t dst_len, struct analyzer_src *src,
+	struct remocon_format_info *info, int *reject)
 {
 	analyzer_t azer;
 	unsigned char buf[ANALYZER_DATA_LEN_MAX];
 	unsigned char buf_tmp[ANALYZER_DATA_LEN_MAX] = { 0 };
-	size_t sz_bit = sz * 8;
+	int sz_bit = src->n_samples;
+	int last_fall = 0, sig_end = 0;
+	int cycle_start = 0, wait_start = 1;
+	struct analyzer_rep rep = { .count = 0 };
 	int r;
 
 	azer.cfg = azer_cfg;
 	azer.ops = azer_ops;
+	azer.dst_len = dst_len;
+	azer.timing = info ? &info->timing : NULL;
+	if (info)
+		memset(info, 0, sizeof(*info));
 
 	analyzer_init(&azer);
-	for (azer.src_idx = 0; azer.src_idx < (int)sz_bit; azer.src_idx++) {
-		char this_bit = get_bit_in_ary(ptn, azer.src_idx);
+	analyzer_src_rewind(src);
+	for (azer.src_idx = 0; azer.src_idx < sz_bit; azer.src_idx++) {
+		char this_bit = analyzer_src_get(src, azer.src_idx);
 
 		if ((azer.state == ANALYZER_STATE_DATA) ||
 		    (azer.state == ANALYZER_STATE_TRAILER))
@@ -127,15 +185,18 @@ analyze(struct analyzer_config *azer_cfg, struct analyzer_ops *azer_ops,
 			azer.dur += 100;
 		} else {
 			r = analyzer_on_flipped(&azer);
-			if (r < 0)
+			if (r < 0) {
+				*reject = analyzer_reject_reason(&azer);
 				return -1;
-			else if (r == DETECTED_PATTERN_LEADER) {
+			} else if (r == DETECTED_PATTERN_LEADER) {
 				azer.state = ANALYZER_STATE_DATA;
 				azer.dst_idx = 0;
 				azer.dur_cycle = azer.dur_prev + azer.dur;
+				memset(buf_tmp, 0, sizeof(buf_tmp));
 			} else if (r == DETECTED_PATTERN_TRAILER) {
 				azer.state = ANALYZER_STATE_LEADER;
 				azer.dur_cycle = 100;
+				wait_start = 1;
 			} else if (r == DETECTED_PATTERN_MARKER) {
 				/* nothing to do */
 			} else if (r == DETECTED_PATTERN_REPEATER_L) {
@@ -145,35 +206,54 @@ analyze(struct analyzer_config *azer_cfg, struct analyzer_ops *azer_ops,
 			} else if (r > 0) {	/* data */
 				int dat = (r == DETECTED_PATTERN_DATA1) ? 1 : 0;
 				if (analyzer_on_bit_detected(&azer, buf_tmp,
-							     dat) < 0)
+							     dat) < 0) {
+					*reject = ANALYZER_REJECT_TOO_LONG;
 					return -1;
+				}
 				azer.dst_idx++;
 			}
 
+			if (this_bit == 0)
+				last_fall = azer.src_idx;
+			else if (wait_start) {
+				cycle_start = azer.src_idx;
+				wait_start = 0;
+			}
 			azer.level = this_bit;
 			azer.dur_prev = azer.dur;
 			azer.dur = 100;
 		}
 
 		r = analyzer_on_each_sample(&azer);
-		if (r < 0)
+		if (r < 0) {
+			*reject = analyzer_reject_reason(&azer);
 			return -1;
-		else if (r == DETECTED_PATTERN_LEADER) {
+		} else if (r == DETECTED_PATTERN_LEADER) {
 			azer.state = ANALYZER_STATE_DATA;
 			azer.dst_idx = 0;
 			azer.dur_cycle = azer.dur_prev + azer.dur;
+			memset(buf_tmp, 0, sizeof(buf_tmp));
 		} else if (r == DETECTED_PATTERN_TRAILER) {
 			if (azer.ops->on_end_cycle(&azer, buf, buf_tmp,
-						   dst_str) < 0)
+						   dst_str) < 0) {
+				*reject = ANALYZER_REJECT_CYCLE;
 				return -1;
+			}
+			analyzer_rep_on_end_cycle(&rep, &azer, buf_tmp,
+						  cycle_start);
 			azer.cycle++;
+			sig_end = azer.src_idx + 1;
+			wait_start = 1;
 			azer.state = ANALYZER_STATE_TRAILER;
 		} else if (r == DETECTED_PATTERN_MARKER) {
 			/* nothing to do */
 		} else if (r > 0) {	/* data */
 			int dat = (r == DETECTED_PATTERN_DATA1) ? 1 : 0;
-			if (analyzer_on_bit_detected(&azer, buf_tmp, dat) < 0)
+			if (analyzer_on_bit_detected(&azer, buf_tmp,
+						     dat) < 0) {
+				*reject = ANALYZER_REJECT_TOO_LONG;
 				return -1;
+			}
 			azer.dst_idx++;
 		}
 	}
@@ -181,29 +261,189 @@ analyze(struct analyzer_config *azer_cfg, struct analyzer_ops *azer_ops,
 	if (azer.cycle == 0) {
 		app_debug(ANALYZER, 1, "[%s] no data cycle detected\n",
 			  azer.cfg->fmt_tag);
+		*reject = ANALYZER_REJECT_NO_FRAME;
 		return -1;
 	}
 
 	/* successfully analyzed */
 	if (azer.ops->on_exit &&
-	    (azer.ops->on_exit(&azer, buf, dst_str) < 0))
+	    (azer.ops->on_exit(&azer, buf, dst_str) < 0)) {
+		*reject = ANALYZER_REJECT_CYCLE;
 		return -1;
+	}
 	strcpy(fmt_tag, azer.cfg->fmt_tag);
 
+	/*
+	 * the signal ends at the last trailer detected, or after the trailer
+	 * of the last pulse (repeaters etc.)
+	 */
+	if (sig_end < last_fall + azer.cfg->trailer_l_len_min / 100)
+		sig_end = last_fall + azer.cfg->trailer_l_len_min / 100;
+	if (info && (sig_end > sz_bit))
+		info->sig_cut = (sig_end - sz_bit + 7) / 8;
+	if (sig_end > sz_bit)
+		sig_end = sz_bit;
+	if (info) {
+		info->sig_len = (sig_end + 7) / 8;
+		info->rep_count = rep.count;
+		info->rep_start = rep.start;
+		info->rep_period = rep.period;
+	}
+
 	return azer.cfg->data_len;
 }
 
-int remocon_format_analyze(char *fmt_tag, char *dst_str,
-			   const unsigned char *ptn, size_t sz)
+static inline unsigned long long timespec_diff_ns(const struct timespec *t0,
+						  const struct timespec *t1)
+{
+	return (t1->tv_sec - t0->tv_sec) * 1000000000ULL +
+	       t1->tv_nsec - t0->tv_nsec;
+}
+
+/*
+ * the stats are shared by the threads.  relaxed atomics are enough for
+ * the counters which are read only by remocon_format_print_stats().
+ */
+static void stats_account(struct analyzer_stats *stats, int r, int reject,
+			  const struct timespec *t0, const struct timespec *t1)
+{
+	__atomic_fetch_add(&stats->attempts, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->time_ns, timespec_diff_ns(t0, t1),
+			   __ATOMIC_RELAXED);
+	if (r >= 0)
+		__atomic_fetch_add(&stats->successes, 1, __ATOMIC_RELAXED);
+	else
+		__atomic_fetch_add(&stats->rejects[reject], 1,
+				   __ATOMIC_RELAXED);
+}
+
+static int analyze_src(char *fmt_tag, char *dst_str, size_t dst_len,
+		       struct analyzer_src *src,
+		       struct remocon_format_info *info)
 {
-	struct analyzer_table analyzer_table[] = ANALYZER_TABLE;
 	unsigned int i;
 
 	for (i = 0; i < ARRAY_SIZE(analyzer_table); i++) {
-		if (analyze(analyzer_table[i].cfg, analyzer_table[i].ops,
-			    fmt_tag, dst_str, ptn, sz) >= 0)
+		struct analyzer_stats *stats = &analyzer_table[i].stats;
+		struct timespec t0, t1;
+		int reject = ANALYZER_REJECT_NO_FRAME;
+		int r;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		r = analyze(analyzer_table[i].cfg, analyzer_table[i].ops,
+			    fmt_tag, dst_str, dst_len, src, info, &reject);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		stats_account(stats, r, reject, &t0, &t1);
+		if (r >= 0)
+			return 0;
+	}
+
+	/* none of the known formats matched. try the generic decoder */
+	{
+		struct timespec t0, t1;
+		int reject = ANALYZER_REJECT_NO_FRAME;
+		int r;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		r = generic_analyze(fmt_tag, dst_str, dst_len, src, info,
+				    &reject);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		stats_account(&generic_stats, r, reject, &t0, &t1);
+		if (r >= 0)
 			return 0;
 	}
 
 	return -1;
 }
+
+int remocon_format_analyze(char *fmt_tag, char *dst_str, size_t dst_len,
+			   const unsigned char *ptn, size_t sz,
+			   struct remocon_format_info *info)
+{
+	struct analyzer_src src = {
+		.ptn = ptn,
+		.n_samples = sz * 8,
+	};
+
+	return analyze_src(fmt_tag, dst_str, dst_len, &src, info);
+}
+
+int remocon_format_analyze_runs(char *fmt_tag, char *dst_str, size_t dst_len,
+				const unsigned int *runs, int n_runs,
+				struct remocon_format_info *info)
+{
+	struct analyzer_src src = {
+		.runs = runs,
+		.n_runs = n_runs,
+		.n_samples = 0,
+	};
+	int i;
+
+	for (i = 0; i < n_runs; i++)
+		src.n_samples += runs[i];
+	return analyze_src(fmt_tag, dst_str, dst_len, &src, info);
+}
+
+static void print_stats_line(FILE *fp, const char *fmt_tag,
+			     const struct analyzer_stats *stats)
+{
+	fprintf(fp, "%-6s %8lu %8lu %8lu %8lu %8lu %8lu %8lu %10.1f\n",
+		fmt_tag, stats->attempts, stats->successes,
+		stats->rejects[ANALYZER_REJECT_LEADER],
+		stats->rejects[ANALYZER_REJECT_DATA],
+		stats->rejects[ANALYZER_REJECT_CYCLE],
+		stats->rejects[ANALYZER_REJECT_TOO_LONG],
+		stats->rejects[ANALYZER_REJECT_NO_FRAME],
+		stats->time_ns / 1000.0);
+}
+
+void remocon_format_print_stats(FILE *fp)
+{
+	unsigned int i;
+
+	fprintf(fp, "%-6s %8s %8s %8s %8s %8s %8s %8s %10s\n",
+		"format", "attempts", "success", "leader", "data",
+		"cycles", "too_long", "no_frame", "time(us)");
+	for (i = 0; i < ARRAY_SIZE(analyzer_table); i++)
+		print_stats_line(fp, analyzer_table[i].cfg->fmt_tag,
+				 &analyzer_table[i].stats);
+	print_stats_line(fp, "GEN", &generic_stats);
+}
+
+void remocon_format_print_timing(FILE *fp,
+				 const struct remocon_format_info *info)
+{
+	static const char * const sym_name[REMOCON_SYM_NUM] = {
+		[REMOCON_SYM_LEADER_H]   = "leader H",
+		[REMOCON_SYM_LEADER_L]   = "leader L",
+		[REMOCON_SYM_DATA_H]     = "data H",
+		[REMOCON_SYM_DATA_L]     = "data L",
+		[REMOCON_SYM_DATA0_H]    = "data0 H",
+		[REMOCON_SYM_DATA0_L]    = "data0 L",
+		[REMOCON_SYM_DATA1_H]    = "data1 H",
+		[REMOCON_SYM_DATA1_L]    = "data1 L",
+		[REMOCON_SYM_REPEATER_H] = "repeat H",
+		[REMOCON_SYM_REPEATER_L] = "repeat L",
+		[REMOCON_SYM_MARKER_L]   = "marker L",
+	};
+	const struct remocon_timing *timing = &info->timing;
+	int i, j;
+
+	/* histogram columns are for |deviation| in us */
+	fprintf(fp, "  %-10s %5s %9s %8s %5s %5s %5s %5s %5s\n",
+		"timing", "count", "mean(us)", "max(us)",
+		"<100", "<200", "<300", "<400", ">=400");
+	for (i = 0; i < REMOCON_SYM_NUM; i++) {
+		if (timing->sym[i].cnt == 0)
+			continue;
+		fprintf(fp, "  %-10s %5d %+9.1f %8d",
+			sym_name[i], timing->sym[i].cnt,
+			(double)timing->sym[i].dev_sum / timing->sym[i].cnt,
+			timing->sym[i].dev_max);
+		for (j = 0; j < REMOCON_TIMING_HIST_NUM; j++)
+			fprintf(fp, " %5d", timing->sym[i].hist[j]);
+		fprintf(fp, "\n");
+	}
+}
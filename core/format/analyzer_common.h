@@ -6,6 +6,8 @@
 #define DEBUG_LEVEL_ANALYZER	0
 #endif
 #include "../debug.h"
+#include "remocon_format.h"
+#include "format_util.h"
 
 #define UNUSED(x)	(void)(x)
 
@@ -39,6 +41,61 @@ enum analyzer_state {
 	ANALYZER_STATE_REPEATER,
 };
 
+/*
+ * reasons an analyzer rejected a pattern (for statistics)
+ */
+enum analyzer_reject {
+	ANALYZER_REJECT_LEADER,		/* leader or idle timing unmatched */
+	ANALYZER_REJECT_DATA,		/* data timing unmatched */
+	ANALYZER_REJECT_CYCLE,		/* inconsistent data in cycles */
+	ANALYZER_REJECT_TOO_LONG,	/* too long data */
+	ANALYZER_REJECT_NO_FRAME,	/* no data cycle detected */
+	ANALYZER_REJECT_NUM,
+};
+
+/*
+ * per analyzer statistics
+ */
+struct analyzer_stats {
+	unsigned long attempts;
+	unsigned long successes;
+	unsigned long rejects[ANALYZER_REJECT_NUM];
+	unsigned long long time_ns;
+};
+
+/*
+ * samples to analyze
+ *   either a bitmap (@ptn) or run lengths (@runs, see
+ *   remocon_format_analyze_runs()).  read them in order from 0 with
+ *   analyzer_src_get().
+ */
+struct analyzer_src {
+	const unsigned char *ptn;
+	const unsigned int *runs;
+	int n_runs;
+	int n_samples;
+
+	/* iterator over @runs */
+	int run_idx;
+	unsigned int run_left;
+};
+
+static inline void analyzer_src_rewind(struct analyzer_src *src)
+{
+	src->run_idx = -1;
+	src->run_left = 0;
+}
+
+static inline int analyzer_src_get(struct analyzer_src *src, int idx)
+{
+	if (src->ptn)
+		return get_bit_in_ary(src->ptn, idx);
+	while (src->run_left == 0)
+		src->run_left = src->runs[++src->run_idx];
+	src->run_left--;
+	return src->run_idx & 1;	/* from low */
+}
+
 /*
  * pre-define analyzer_t
  */
@@ -91,6 +148,49 @@ struct analyzer {
 	int dur;
 	int dur_prev;
 	int dur_cycle;
+
+	/* the ops fill dst_str up to this */
+	size_t dst_len;
+
+	/*
+	 * timing quality (may be NULL)
+	 */
+	struct remocon_timing *timing;
 };
 
+/*
+ * record the deviation of a detected duration from the typical one
+ */
+static inline void remocon_timing_add(struct remocon_timing *timing,
+				      enum remocon_sym sym, int dur, int typ)
+{
+	int dev = dur - typ;
+	int dev_abs = (dev < 0) ? -dev : dev;
+	int bin = dev_abs / 100;
+
+	if (timing == NULL)
+		return;
+	if (bin >= REMOCON_TIMING_HIST_NUM)
+		bin = REMOCON_TIMING_HIST_NUM - 1;
+
+	timing->sym[sym].cnt++;
+	timing->sym[sym].dev_sum += dev;
+	if (timing->sym[sym].dev_max < dev_abs)
+		timing->sym[sym].dev_max = dev_abs;
+	timing->sym[sym].hist[bin]++;
+}
+
+static inline void analyzer_timing_add(const analyzer_t *azer,
+				       enum remocon_sym sym, int dur, int typ)
+{
+	remocon_timing_add(azer->timing, sym, dur, typ);
+}
+
+/*
+ * fallback decoder for unknown formats (generic.c)
+ */
+extern int generic_analyze(char *fmt_tag, char *dst_str, size_t dst_len,
+			   struct analyzer_src *src,
+			   struct remocon_format_info *info, int *reject);
+
 #endif	/* _ANALYZER_COMMON_H */
@@ -19,14 +19,15 @@ extern struct analyzer_ops koiz_azer_ops;
 struct analyzer_table {
 	struct analyzer_config *cfg;
 	struct analyzer_ops *ops;
+	struct analyzer_stats stats;
 };
 
 #define ANALYZER_TABLE	{ \
-	{ &aeha_azer_cfg, &aeha_azer_ops }, \
-	{ &dkin_azer_cfg, &dkin_azer_ops }, \
-	{ &nec_azer_cfg,  &nec_azer_ops }, \
-	{ &sony_azer_cfg, &sony_azer_ops }, \
-	{ &koiz_azer_cfg, &koiz_azer_ops }, \
+	{ .cfg = &aeha_azer_cfg, .ops = &aeha_azer_ops }, \
+	{ .cfg = &dkin_azer_cfg, .ops = &dkin_azer_ops }, \
+	{ .cfg = &nec_azer_cfg,  .ops = &nec_azer_ops }, \
+	{ .cfg = &sony_azer_cfg, .ops = &sony_azer_ops }, \
+	{ .cfg = &koiz_azer_cfg, .ops = &koiz_azer_ops }, \
 }
 
 #endif /* _ANALYZER_CONFIG_H */
@@ -65,6 +65,8 @@ static int dkin_on_flip_up(const analyzer_t *azer)
 		    (azer->dur <= azer->cfg->leader_l_len_max)) {
 			app_debug(ANALYZER, 2, "[%s] leader detected at %d\n",
 				  azer->cfg->fmt_tag, azer->src_idx);
+			analyzer_timing_add(azer, REMOCON_SYM_LEADER_L,
+					    azer->dur, DKIN_LEADER_L_LEN_TYP);
 			return DETECTED_PATTERN_LEADER;
 		}
 	} else if (azer->state == ANALYZER_STATE_DATA) {
@@ -73,12 +75,16 @@ static int dkin_on_flip_up(const analyzer_t *azer)
 			app_debug(ANALYZER, 2, "[%s] data0 (bit%d) at %d\n",
 				  azer->cfg->fmt_tag,
 				  azer->dst_idx, azer->src_idx);
+			analyzer_timing_add(azer, REMOCON_SYM_DATA0_L,
+					    azer->dur, DKIN_DATA0_L_LEN_TYP);
 			return DETECTED_PATTERN_DATA0;
 		} else if ((azer->dur >= DKIN_DATA1_L_LEN_MIN) &&
 			   (azer->dur <= DKIN_DATA1_L_LEN_MAX)) {
 			app_debug(ANALYZER, 2, "[%s] data1 (bit%d) at %d\n",
 				  azer->cfg->fmt_tag,
 				  azer->dst_idx, azer->src_idx);
+			analyzer_timing_add(azer, REMOCON_SYM_DATA1_L,
+					    azer->dur, DKIN_DATA1_L_LEN_TYP);
 			return DETECTED_PATTERN_DATA1;
 		}
 	} else if (azer->state == ANALYZER_STATE_TRAILER) {
@@ -96,12 +102,18 @@ static int dkin_on_flip_dn(const analyzer_t *azer)
 {
 	if (azer->state == ANALYZER_STATE_LEADER) {
 		if ((azer->dur >= azer->cfg->leader_h_len_min) &&
-		    (azer->dur <= azer->cfg->leader_h_len_max))
+		    (azer->dur <= azer->cfg->leader_h_len_max)) {
+			analyzer_timing_add(azer, REMOCON_SYM_LEADER_H,
+					    azer->dur, DKIN_LEADER_H_LEN_TYP);
 			return 0;
+		}
 	} else if (azer->state == ANALYZER_STATE_DATA) {
 		if ((azer->dur >= DKIN_DATA_H_LEN_MIN) &&
-		    (azer->dur <= DKIN_DATA_H_LEN_MAX))
+		    (azer->dur <= DKIN_DATA_H_LEN_MAX)) {
+			analyzer_timing_add(azer, REMOCON_SYM_DATA_H,
+					    azer->dur, DKIN_DATA_H_LEN_TYP);
 			return 0;
+		}
 	}
 
 	app_debug(ANALYZER, 1,
@@ -149,13 +161,14 @@ static int dkin_on_end_cycle(const analyzer_t *azer,
 	cmd_str[bytes_got * 2 - 5] = '\0';
 
 	if (azer->cycle == 0) {
-		sprintf(dst_str, "custom=%s cmd=%s (%d bits in total)",
-			custom_str, cmd_str, azer->dst_idx);
+		snprintf(dst_str, azer->dst_len,
+			 "custom=%s cmd=%s (%d bits in total)",
+			 custom_str, cmd_str, azer->dst_idx);
 		memcpy(buf0, buf, azer->cfg->data_len);
 	} else {
 		/* concat if data is different from previous */
 		if (memcmp(buf0, buf, azer->cfg->data_len))
-			strcatf(dst_str,
+			strncatf(dst_str, azer->dst_len,
 				" + custom=%s cmd=%s (%d bits in total)",
 				custom_str, cmd_str, azer->dst_idx);
 	}
@@ -244,5 +257,5 @@ int remocon_format_forge_dkin(unsigned char *ptn, size_t sz,
 		forge_dur(&fger, 0, DKIN_TRAILER_L_LEN_TYP);
 	}
 
-	return 0;
+	return forger_len(&fger);
 }
@@ -33,24 +33,33 @@ void forger_init(forger_t *fger, unsigned char *ptn, size_t ptn_len)
 	memset(ptn, 0, ptn_len);
 }
 
+/*
+ * fill the samples up to @fger->t_flip with @val
+ * samples out of the pattern are dropped.
+ */
+static void forge_fill(forger_t *fger, int val)
+{
+	unsigned long from = fger->t / 100;
+	unsigned long to = (fger->t_flip + 99) / 100;
+	unsigned long sz_bit = fger->ptn_len * 8;
+
+	if (to <= from)
+		return;
+	if (val && (from < sz_bit))
+		set_bits_in_ary(fger->ptn, from, (to < sz_bit) ? to : sz_bit);
+	fger->t = to * 100;
+}
+
 void forge_dur(forger_t *fger, int val, int dur)
 {
-	for (fger->t_flip += dur;
-	     fger->t < fger->t_flip;
-	     fger->t += 100) {
-		if (val)
-			set_bit_in_ary(fger->ptn, fger->t / 100);
-	}
+	fger->t_flip += dur;
+	forge_fill(fger, val);
 }
 
 void forge_until(forger_t *fger, int val, int until)
 {
-	for (fger->t_flip = until;
-	     fger->t < fger->t_flip;
-	     fger->t += 100) {
-		if (val)
-			set_bit_in_ary(fger->ptn, fger->t / 100);
-	}
+	fger->t_flip = until;
+	forge_fill(fger, val);
 }
 
 void forge_pulse(forger_t *fger, int h_len, int l_len)
@@ -58,3 +67,12 @@ void forge_pulse(forger_t *fger, int h_len, int l_len)
 	forge_dur(fger, 1, h_len);
 	forge_dur(fger, 0, l_len);
 }
+
+/*
+ * returns the end of the signal forged so far in bytes.
+ * it can exceed @fger->ptn_len if the signal didn't fit in the pattern.
+ */
+int forger_len(const forger_t *fger)
+{
+	return (fger->t / 100 + 7) / 8;
+}
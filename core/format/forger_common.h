@@ -8,9 +8,13 @@ typedef struct {
 	size_t ptn_len;
 } forger_t;
 
+/*
+ * @ptn can be any length.  samples beyond @ptn_len are dropped.
+ */
 extern void forger_init(forger_t *fger, unsigned char *ptn, size_t ptn_len);
 extern void forge_dur(forger_t *fger, int val, int dur);
 extern void forge_until(forger_t *fger, int val, int until);
 extern void forge_pulse(forger_t *fger, int h_len, int l_len);
+extern int forger_len(const forger_t *fger);
 
 #endif	/* _FORGER_COMMON_H */
@@ -1,6 +1,8 @@
 #ifndef _FORMAT_UTIL_H
 #define _FORMAT_UTIL_H
 
+#include <string.h>
+
 static inline char get_bit_in_ary(const unsigned char *ary, int idx)
 {
 	return (ary[idx / 8] >> (idx & 0x7)) & 0x01;
@@ -11,4 +13,25 @@ static inline void set_bit_in_ary(unsigned char *ary, int idx)
 	ary[idx / 8] |= (1 << (idx & 0x7));
 }
 
+/*
+ * set bits in [@from, @to)
+ */
+static inline void set_bits_in_ary(unsigned char *ary, int from, int to)
+{
+	int from_byte = from / 8, to_byte = to / 8;
+
+	if (from >= to)
+		return;
+	if (from_byte == to_byte) {
+		ary[from_byte] |= (0xff << (from & 0x7)) &
+				  ~(0xff << (to & 0x7));
+		return;
+	}
+	if (from & 0x7)
+		ary[from_byte++] |= 0xff << (from & 0x7);
+	memset(&ary[from_byte], 0xff, to_byte - from_byte);
+	if (to & 0x7)
+		ary[to_byte] |= ~(0xff << (to & 0x7));
+}
+
 #endif	/* _FORMAT_UTIL_H */
@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../string_util.h"
+#include "format_util.h"
+#include "analyzer_common.h"
+
+/*
+ * generic pulse distance / pulse width decoder
+ *
+ * used when none of the known analyzers matches.
+ * | leader (optional) | data | stop bit (PDM only) | gap |
+ *
+ * PDM (pulse distance):  HIGH is constant, LOW has 2 lengths
+ * PWM (pulse width):     LOW is constant, HIGH has 2 lengths
+ *
+ * HIGH and LOW durations are clustered separately, and the leader is
+ * the first pair when it is clearly longer than the data symbols.
+ * a LOW longer than GEN_GAP_LEN_MIN separates frames.
+ */
+#define GEN_GAP_LEN_MIN		6000
+#define GEN_DATA_BITS_MIN	8
+#define GEN_CLUSTER_MAX		2
+#define GEN_LEADER_RATIO	16	/* x0.1 */
+#define GEN_REP_JITTER		3	/* in samples */
+
+struct gen_run {
+	int h_len;	/* in samples */
+	int l_len;	/* in samples. 0 if the pattern ends with HIGH */
+};
+
+struct gen_cluster {
+	int n;
+	int sum;
+	int min, max;
+};
+
+#define gen_cluster_center(cl)	((cl)->sum / (cl)->n)
+
+static int int_cmp(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * 1-dimensional clustering of sorted values
+ * a new cluster starts where the value jumps by 35% and 2 samples
+ * returns the number of clusters, or -1 if there are too many
+ */
+static int cluster(int *vals, int n, struct gen_cluster *cl, int cl_max)
+{
+	int n_cl = 0;
+	int i;
+
+	qsort(vals, n, sizeof(int), int_cmp);
+	for (i = 0; i < n; i++) {
+		struct gen_cluster *c = n_cl ? &cl[n_cl - 1] : NULL;
+
+		if ((c == NULL) ||
+		    ((vals[i] * 100 > c->max * 135) &&
+		     (vals[i] - c->max >= 2))) {
+			if (n_cl == cl_max)
+				return -1;
+			c = &cl[n_cl++];
+			c->n = 0;
+			c->sum = 0;
+			c->min = vals[i];
+		}
+		c->n++;
+		c->sum += vals[i];
+		c->max = vals[i];
+	}
+
+	return n_cl;
+}
+
+static inline int nearest(const struct gen_cluster *cl, int n_cl, int v)
+{
+	int best = 0;
+	int i;
+
+	for (i = 1; i < n_cl; i++) {
+		if (abs(v - gen_cluster_center(&cl[i])) <
+		    abs(v - gen_cluster_center(&cl[best])))
+			best = i;
+	}
+	return best;
+}
+
+/*
+ * split the pattern into HIGH/LOW pairs
+ * returns the number of pairs, and the number of leading 0s in @lead
+ */
+static int get_runs(struct analyzer_src *src, struct gen_run *runs, int *lead)
+{
+	int n = -1;
+	int idx;
+
+	*lead = 0;
+	analyzer_src_rewind(src);
+	for (idx = 0; idx < src->n_samples; idx++) {
+		if (analyzer_src_get(src, idx)) {
+			if ((n < 0) || runs[n].l_len) {
+				n++;
+				runs[n].h_len = 0;
+				runs[n].l_len = 0;
+			}
+			runs[n].h_len++;
+		} else if (n < 0) {
+			(*lead)++;
+		} else {
+			runs[n].l_len++;
+		}
+	}
+
+	return n + 1;
+}
+
+static inline int is_gap(const struct gen_run *run)
+{
+	return (run->l_len == 0) || (run->l_len * 100 >= GEN_GAP_LEN_MIN);
+}
+
+static int runs_len(const struct gen_run *runs, int first, int last)
+{
+	int len = 0;
+	int i;
+
+	for (i = first; i <= last; i++)
+		len += runs[i].h_len + runs[i].l_len;
+	return len;
+}
+
+/* returns the index of the last pair in the frame starting at @start */
+static int frame_end(const struct gen_run *runs, int n_runs, int start)
+{
+	int i;
+
+	for (i = start; (i < n_runs - 1) && !is_gap(&runs[i]); i++)
+		;
+	return i;
+}
+
+/*
+ * bytes up to the end of the gap after the last pulse
+ * @cut gets the bytes of the gap beyond the pattern
+ */
+static size_t get_sig_len(const struct gen_run *runs, int n_runs, int lead,
+			  int n_samples, size_t *cut)
+{
+	int sig_end;
+
+	sig_end = lead + runs_len(runs, 0, n_runs - 1) -
+		  runs[n_runs - 1].l_len + GEN_GAP_LEN_MIN / 100;
+	*cut = 0;
+	if (sig_end > n_samples) {
+		*cut = (size_t)(sig_end - n_samples + 7) / 8;
+		sig_end = n_samples;
+	}
+
+	return (size_t)(sig_end + 7) / 8;
+}
+
+int generic_analyze(char *fmt_tag, char *dst_str, size_t dst_len,
+		    struct analyzer_src *src,
+		    struct remocon_format_info *info, int *reject)
+{
+	struct remocon_timing *timing = info ? &info->timing : NULL;
+	struct gen_run *runs;
+	int *vals_h, *vals_l;
+	int n_runs, n_h = 0, n_l = 0;
+	struct gen_cluster cl_h[GEN_CLUSTER_MAX], cl_l[GEN_CLUSTER_MAX];
+	int n_cl_h, n_cl_l;
+	int is_pwm;
+	unsigned char bits[ANALYZER_DATA_LEN_MAX];
+	unsigned char bits_tmp[ANALYZER_DATA_LEN_MAX];
+	int n_bits = -1, n_bits_tmp;
+	int frames = 0, frames_diff = 0, frames_rep = 0;
+	int leader_h = 0, leader_l = 0, stop_h = 0, gap_l = 0;
+	int rep_count = 0, rep_start = 0, rep_last = 0, rep_period = 0;
+	int lead, pos;
+	int i, j, k;
+	int r = -1;
+
+	*reject = ANALYZER_REJECT_NO_FRAME;
+	if (info)
+		memset(info, 0, sizeof(*info));
+	runs = malloc(sizeof(*runs) * (src->n_samples / 2 + 1));
+	vals_h = malloc(sizeof(int) * (src->n_samples / 2 + 1));
+	vals_l = malloc(sizeof(int) * (src->n_samples / 2 + 1));
+	if (!runs || !vals_h || !vals_l) {
+		app_error("%s(): memory allocation failed.\n", __func__);
+		goto out;
+	}
+	n_runs = get_runs(src, runs, &lead);
+	if (n_runs < GEN_DATA_BITS_MIN)
+		goto out;
+
+	/*
+	 * collect data symbols.
+	 * first pair of each frame can be a leader, and the last LOW is
+	 * the gap. both are excluded.
+	 */
+	for (i = 0; i < n_runs; i = j + 1) {
+		j = frame_end(runs, n_runs, i);
+		for (k = i + 1; k <= j; k++) {
+			vals_h[n_h++] = runs[k].h_len;
+			if (k < j)
+				vals_l[n_l++] = runs[k].l_len;
+		}
+	}
+	if ((n_h == 0) || (n_l == 0))
+		goto out;
+
+	*reject = ANALYZER_REJECT_DATA;
+	n_cl_h = cluster(vals_h, n_h, cl_h, GEN_CLUSTER_MAX);
+	n_cl_l = cluster(vals_l, n_l, cl_l, GEN_CLUSTER_MAX);
+	if ((n_cl_h == 1) && (n_cl_l == 2))
+		is_pwm = 0;
+	else if ((n_cl_h == 2) && (n_cl_l == 1))
+		is_pwm = 1;
+	else {
+		app_debug(ANALYZER, 1,
+			  "[GEN] unclassified symbols (%d HIGH / %d LOW)\n",
+			  n_cl_h, n_cl_l);
+		goto out;
+	}
+
+	/*
+	 * decode each frame
+	 */
+	for (i = 0, pos = lead; i < n_runs;
+	     pos += runs_len(runs, i, j), i = j + 1) {
+		int max_h = cl_h[n_cl_h - 1].max;
+		int max_l = cl_l[n_cl_l - 1].max;
+		int has_leader;
+
+		j = frame_end(runs, n_runs, i);
+		has_leader = (runs[i].h_len * 10 >= max_h * GEN_LEADER_RATIO) ||
+			     (!is_gap(&runs[i]) &&
+			      (runs[i].l_len * 10 >= max_l * GEN_LEADER_RATIO));
+
+		memset(bits_tmp, 0, sizeof(bits_tmp));
+		n_bits_tmp = 0;
+		for (k = has_leader ? i + 1 : i; k <= j; k++) {
+			int bit;
+
+			if (is_pwm) {
+				bit = nearest(cl_h, n_cl_h, runs[k].h_len);
+				remocon_timing_add(timing, bit ?
+						   REMOCON_SYM_DATA1_H :
+						   REMOCON_SYM_DATA0_H,
+						   runs[k].h_len * 100,
+						   gen_cluster_center(&cl_h[bit]) *
+						   100);
+				if (k < j)
+					remocon_timing_add(timing,
+						REMOCON_SYM_DATA_L,
+						runs[k].l_len * 100,
+						gen_cluster_center(&cl_l[0]) *
+						100);
+			} else {
+				remocon_timing_add(timing, REMOCON_SYM_DATA_H,
+						   runs[k].h_len * 100,
+						   gen_cluster_center(&cl_h[0]) *
+						   100);
+				if (k == j)	/* stop bit */
+					break;
+				bit = nearest(cl_l, n_cl_l, runs[k].l_len);
+				remocon_timing_add(timing, bit ?
+						   REMOCON_SYM_DATA1_L :
+						   REMOCON_SYM_DATA0_L,
+						   runs[k].l_len * 100,
+						   gen_cluster_center(&cl_l[bit]) *
+						   100);
+			}
+			if (n_bits_tmp == ANALYZER_DATA_LEN_MAX * 8) {
+				*reject = ANALYZER_REJECT_TOO_LONG;
+				goto out;
+			}
+			if (bit)
+				set_bit_in_ary(bits_tmp, n_bits_tmp);
+			n_bits_tmp++;
+		}
+
+		if (n_bits_tmp == 0) {		/* repeat code or so */
+			frames_rep++;
+			if (rep_count > 0)	/* no more identical frames */
+				rep_count = -rep_count;
+			continue;
+		}
+		frames++;
+		if (n_bits < 0) {
+			memcpy(bits, bits_tmp, sizeof(bits));
+			n_bits = n_bits_tmp;
+			rep_count = 1;
+			rep_start = rep_last = pos;
+			if (has_leader) {
+				leader_h = runs[i].h_len;
+				leader_l = runs[i].l_len;
+			}
+			stop_h = runs[j].h_len;
+			gap_l = runs[j].l_len;
+		} else if ((n_bits != n_bits_tmp) ||
+			   memcmp(bits, bits_tmp, (n_bits + 7) / 8)) {
+			frames_diff++;
+			if (rep_count > 0)
+				rep_count = -rep_count;
+		} else if (rep_count > 0) {	/* identical */
+			if (rep_count == 1)
+				rep_period = pos - rep_last;
+			if (abs(pos - rep_last - rep_period) > GEN_REP_JITTER) {
+				rep_count = -rep_count;
+			} else {
+				rep_last = pos;
+				rep_count++;
+			}
+		}
+	}
+	if (n_bits < GEN_DATA_BITS_MIN) {
+		*reject = ANALYZER_REJECT_NO_FRAME;
+		goto out;
+	}
+
+	/*
+	 * data=<hex in sending order> (n bits)
+	 * leader=H/L zero=H/L one=H/L trailer=[H/]L (us)
+	 */
+	snprintf(dst_str, dst_len, "data=");
+	for (i = 0; i < (n_bits + 7) / 8; i++)
+		strncatf(dst_str, dst_len, "%02x", bits[i]);
+	strncatf(dst_str, dst_len, " (%d bits)", n_bits);
+	if (leader_h)
+		strncatf(dst_str, dst_len, " leader=%d/%d",
+			leader_h * 100, leader_l * 100);
+	if (is_pwm) {
+		strncatf(dst_str, dst_len,
+			" zero=%d/%d one=%d/%d trailer=%d",
+			gen_cluster_center(&cl_h[0]) * 100,
+			gen_cluster_center(&cl_l[0]) * 100,
+			gen_cluster_center(&cl_h[1]) * 100,
+			gen_cluster_center(&cl_l[0]) * 100,
+			gap_l * 100);
+	} else {
+		strncatf(dst_str, dst_len,
+			" zero=%d/%d one=%d/%d trailer=%d/%d",
+			gen_cluster_center(&cl_h[0]) * 100,
+			gen_cluster_center(&cl_l[0]) * 100,
+			gen_cluster_center(&cl_h[0]) * 100,
+			gen_cluster_center(&cl_l[1]) * 100,
+			stop_h * 100, gap_l * 100);
+	}
+	if (frames > 1)
+		strncatf(dst_str, dst_len, " x%d", frames);
+	if (frames_diff)
+		strncatf(dst_str, dst_len, " (%d differ)", frames_diff);
+	if (frames_rep)
+		strncatf(dst_str, dst_len, " +%d repeat", frames_rep);
+	strcpy(fmt_tag, is_pwm ? "PWM" : "PDM");
+	if (info) {
+		info->sig_len = get_sig_len(runs, n_runs, lead,
+					    src->n_samples, &info->sig_cut);
+		info->rep_count = abs(rep_count);
+		info->rep_start = rep_start;
+		info->rep_period = rep_period;
+	}
+	r = 0;
+
+out:
+	free(runs);
+	free(vals_h);
+	free(vals_l);
+	return r;
+}
@@ -52,6 +52,7 @@
 #define KOIZ_MARKER_L_LEN_MIN	4500
 #define KOIZ_MARKER_L_LEN_TYP	5000
 #define KOIZ_MARKER_L_LEN_MAX	5500
+#define KOIZ_START_H_LEN_TYP	 830
 #define KOIZ_MARKER_BIT_POS1	9
 #define KOIZ_MARKER_BIT_POS2	12
 
@@ -66,8 +67,11 @@ static int koiz_on_flip_dn(const analyzer_t *azer)
 {
 	if (azer->state == ANALYZER_STATE_LEADER) {
 		if ((azer->dur >= azer->cfg->leader_h_len_min) &&
-		    (azer->dur <= azer->cfg->leader_h_len_max))
+		    (azer->dur <= azer->cfg->leader_h_len_max)) {
+			analyzer_timing_add(azer, REMOCON_SYM_LEADER_H,
+					    azer->dur, KOIZ_START_H_LEN_TYP);
 			return 0;
+		}
 	} else if (azer->state == ANALYZER_STATE_DATA) {
 		if ((azer->dur_prev >= KOIZ_DATA0_L_LEN_MIN) &&
 		    (azer->dur_prev <= KOIZ_DATA0_L_LEN_MAX) &&
@@ -76,6 +80,11 @@ static int koiz_on_flip_dn(const analyzer_t *azer)
 			app_debug(ANALYZER, 2, "[%s] data0 (bit%d) at %d\n",
 				  azer->cfg->fmt_tag,
 				  azer->dst_idx, azer->src_idx);
+			analyzer_timing_add(azer, REMOCON_SYM_DATA0_L,
+					    azer->dur_prev,
+					    KOIZ_DATA0_L_LEN_TYP);
+			analyzer_timing_add(azer, REMOCON_SYM_DATA0_H,
+					    azer->dur, KOIZ_DATA0_H_LEN_TYP);
 			return DETECTED_PATTERN_DATA0;
 		} else if ((azer->dur_prev >= KOIZ_DATA1_L_LEN_MIN) &&
 			   (azer->dur_prev <= KOIZ_DATA1_L_LEN_MAX) &&
@@ -84,6 +93,11 @@ static int koiz_on_flip_dn(const analyzer_t *azer)
 			app_debug(ANALYZER, 2, "[%s] data1 (bit%d) at %d\n",
 				  azer->cfg->fmt_tag,
 				  azer->dst_idx, azer->src_idx);
+			analyzer_timing_add(azer, REMOCON_SYM_DATA1_L,
+					    azer->dur_prev,
+					    KOIZ_DATA1_L_LEN_TYP);
+			analyzer_timing_add(azer, REMOCON_SYM_DATA1_H,
+					    azer->dur, KOIZ_DATA1_H_LEN_TYP);
 			return DETECTED_PATTERN_DATA1;
 		} else if ((azer->dur_prev >= KOIZ_MARKER_L_LEN_MIN) &&
 			   (azer->dur_prev <= KOIZ_MARKER_L_LEN_MAX) &&
@@ -100,6 +114,11 @@ static int koiz_on_flip_dn(const analyzer_t *azer)
 			}
 			app_debug(ANALYZER, 2, "[%s] marker at %d\n",
 				  azer->cfg->fmt_tag, azer->src_idx);
+			analyzer_timing_add(azer, REMOCON_SYM_MARKER_L,
+					    azer->dur_prev,
+					    KOIZ_MARKER_L_LEN_TYP);
+			analyzer_timing_add(azer, REMOCON_SYM_LEADER_H,
+					    azer->dur, KOIZ_START_H_LEN_TYP);
 			return DETECTED_PATTERN_MARKER;
 		}
 	} else
@@ -172,7 +191,8 @@ static int koiz_on_end_cycle(const analyzer_t *azer,
 				  dst_cmd, tmp_cmd1, tmp_cmd2);
 			return -1;
 		}
-		sprintf(dst_str, "id=%02x cmd=%04x", id, tmp_cmd1);
+		snprintf(dst_str, azer->dst_len, "id=%02x cmd=%04x",
+			 id, tmp_cmd1);
 		memcpy(buf0, buf, azer->cfg->data_len);
 	} else {
 		if (memcmp(buf0, buf, azer->cfg->data_len)) {
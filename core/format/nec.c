@@ -80,12 +80,20 @@ static int nec_on_flip_up(const analyzer_t *azer)
 				app_debug(ANALYZER, 2,
 					  "[%s] leader detected at %d\n",
 					  azer->cfg->fmt_tag, azer->src_idx);
+				analyzer_timing_add(azer, REMOCON_SYM_LEADER_L,
+						    azer->dur,
+						    NEC_LEADER_L_LEN_TYP);
 				return DETECTED_PATTERN_LEADER;
 			}
 		} else {	/* expect repeat signal */
 			if ((azer->dur >= NEC_REPEATER_L_LEN_MIN) &&
-			    (azer->dur <= NEC_REPEATER_L_LEN_MAX))
+			    (azer->dur <= NEC_REPEATER_L_LEN_MAX)) {
+				analyzer_timing_add(azer,
+						    REMOCON_SYM_REPEATER_L,
+						    azer->dur,
+						    NEC_REPEATER_L_LEN_TYP);
 				return DETECTED_PATTERN_REPEATER_L;
+			}
 		}
 	} else if (azer->state == ANALYZER_STATE_DATA) {
 		if ((azer->dur >= NEC_DATA0_L_LEN_MIN) &&
@@ -93,11 +101,15 @@ static int nec_on_flip_up(const analyzer_t *azer)
 			app_debug(ANALYZER, 2, "[%s] data0 (bit%d) at %d\n",
 				  azer->cfg->fmt_tag,
 				  azer->dst_idx, azer->src_idx);
+			analyzer_timing_add(azer, REMOCON_SYM_DATA0_L,
+					    azer->dur, NEC_DATA0_L_LEN_TYP);
 			return DETECTED_PATTERN_DATA0;
 		} else if ((azer->dur >= NEC_DATA1_L_LEN_MIN) &&
 			   (azer->dur <= NEC_DATA1_L_LEN_MAX)) {
 			app_debug(ANALYZER, 2, "[%s] data1 at %d\n",
 				  azer->cfg->fmt_tag, azer->src_idx);
+			analyzer_timing_add(azer, REMOCON_SYM_DATA1_L,
+					    azer->dur, NEC_DATA1_L_LEN_TYP);
 			return DETECTED_PATTERN_DATA1;
 		}
 	} else if (azer->state == ANALYZER_STATE_TRAILER) {
@@ -115,19 +127,30 @@ static int nec_on_flip_dn(const analyzer_t *azer)
 {
 	if (azer->state == ANALYZER_STATE_LEADER) {
 		if ((azer->dur >= azer->cfg->leader_h_len_min) &&
-		    (azer->dur <= azer->cfg->leader_h_len_max))
+		    (azer->dur <= azer->cfg->leader_h_len_max)) {
+			/* the leader and the repeater have the same HIGH */
+			analyzer_timing_add(azer, (azer->cycle == 0) ?
+						  REMOCON_SYM_LEADER_H :
+						  REMOCON_SYM_REPEATER_H,
+					    azer->dur, NEC_LEADER_H_LEN_TYP);
 			return 0;
+		}
 	} else if (azer->state == ANALYZER_STATE_REPEATER) {
 		if ((azer->dur >= NEC_DATA_H_LEN_MIN) &&
 		    (azer->dur <= NEC_DATA_H_LEN_MAX)) {
 			app_debug(ANALYZER, 2, "[%s] repeater detected at %d\n",
 				  azer->cfg->fmt_tag, azer->src_idx);
+			analyzer_timing_add(azer, REMOCON_SYM_DATA_H,
+					    azer->dur, NEC_DATA_H_LEN_TYP);
 			return DETECTED_PATTERN_REPEATER_H;
 		}
 	} else if (azer->state == ANALYZER_STATE_DATA) {
 		if ((azer->dur >= NEC_DATA_H_LEN_MIN) &&
-		    (azer->dur <= NEC_DATA_H_LEN_MAX))
+		    (azer->dur <= NEC_DATA_H_LEN_MAX)) {
+			analyzer_timing_add(azer, REMOCON_SYM_DATA_H,
+					    azer->dur, NEC_DATA_H_LEN_TYP);
 			return 0;
+		}
 	}
 
 	app_debug(ANALYZER, 1,
@@ -166,7 +189,8 @@ static int nec_on_end_cycle(const analyzer_t *azer,
 				  buf[0], buf[1], buf[2], buf[3]);
 			return -1;
 		}
-		sprintf(dst_str, "custom=%04x cmd=%02x", custom, cmd);
+		snprintf(dst_str, azer->dst_len, "custom=%04x cmd=%02x",
+			 custom, cmd);
 
 		memcpy(buf0, buf, azer->cfg->data_len);
 	} else {
@@ -263,5 +287,5 @@ int remocon_format_forge_nec(unsigned char *ptn, size_t sz,
 	forge_pulse(&fger, NEC_REPEATER_H_LEN_TYP, NEC_REPEATER_L_LEN_TYP);
 	forge_dur(&fger, 1, NEC_DATA_H_LEN_TYP);
 
-	return 0;
+	return forger_len(&fger);
 }
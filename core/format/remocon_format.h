@@ -1,13 +1,88 @@
 #ifndef _REMOCON_FORMAT_H
 #define _REMOCON_FORMAT_H
 
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * symbol classes for timing quality
+ */
+enum remocon_sym {
+	REMOCON_SYM_LEADER_H,
+	REMOCON_SYM_LEADER_L,
+	REMOCON_SYM_DATA_H,
+	REMOCON_SYM_DATA_L,
+	REMOCON_SYM_DATA0_H,
+	REMOCON_SYM_DATA0_L,
+	REMOCON_SYM_DATA1_H,
+	REMOCON_SYM_DATA1_L,
+	REMOCON_SYM_REPEATER_H,
+	REMOCON_SYM_REPEATER_L,
+	REMOCON_SYM_MARKER_L,
+	REMOCON_SYM_NUM,
+};
+
+/* histogram of |deviation|: 100us per bin, the last bin for the rest */
+#define REMOCON_TIMING_HIST_NUM	5
+
+/*
+ * deviation of the detected durations from the typical ones
+ */
+struct remocon_timing {
+	struct {
+		int cnt;
+		long dev_sum;	/* signed, in us */
+		int dev_max;	/* absolute, in us */
+		int hist[REMOCON_TIMING_HIST_NUM];
+	} sym[REMOCON_SYM_NUM];
+};
+
+/*
+ * additional information about the analyzed pattern
+ */
+struct remocon_format_info {
+	struct remocon_timing timing;
+	size_t sig_len;		/* bytes up to the end of the last trailer */
+	size_t sig_cut;		/* bytes of the trailer beyond the pattern */
+
+	/*
+	 * the first @rep_count data cycles are identical, and repeated
+	 * every @rep_period samples from @rep_start.  (none if < 2)
+	 */
+	int rep_count;
+	int rep_start;
+	int rep_period;
+};
+
+/*
+ * forgers return the length of the forged signal in bytes.
+ * it can be larger than @sz, then the signal is clipped.
+ */
 extern int remocon_format_forge_nec(unsigned char *ptn, size_t sz,
 				    unsigned short custom, unsigned char cmd);
 extern int remocon_format_forge_aeha(unsigned char *ptn, size_t sz,
 				     unsigned long custom, unsigned long cmd);
 extern int remocon_format_forge_sony(unsigned char *ptn, size_t sz,
 				     unsigned long prod, unsigned long cmd);
-extern int remocon_format_analyze(char *fmt_tag, char *dst_str,
-				  const unsigned char *ptn, size_t sz);
+extern int remocon_format_forge_dkin(unsigned char *ptn, size_t sz,
+				     unsigned long custom, unsigned long cmd);
+/*
+ * @dst_str gets the decoded data, truncated to @dst_len bytes
+ */
+extern int remocon_format_analyze(char *fmt_tag, char *dst_str, size_t dst_len,
+				  const unsigned char *ptn, size_t sz,
+				  struct remocon_format_info *info);
+/*
+ * same as remocon_format_analyze(), but the pattern is given as run
+ * lengths in samples, alternating between low and high from low.
+ * sig_len etc. in @info are still in bytes of the bitmap.
+ */
+extern int remocon_format_analyze_runs(char *fmt_tag, char *dst_str,
+				       size_t dst_len,
+				       const unsigned int *runs, int n_runs,
+				       struct remocon_format_info *info);
+extern void remocon_format_print_timing(FILE *fp,
+					const struct remocon_format_info *info);
+extern void remocon_format_print_stats(FILE *fp);
 
 #endif	/* _REMOCON_FORMAT_H */
@@ -64,8 +64,12 @@ static int sony_on_flip_up(const analyzer_t *azer)
 		/* didn't have enough 0 for leader */
 	} else if (azer->state == ANALYZER_STATE_DATA) {
 		if ((azer->dur >= SONY_DATA_L_LEN_MIN) &&
-		    (azer->dur <= SONY_DATA_L_LEN_MAX))
+		    (azer->dur <= SONY_DATA_L_LEN_MAX)) {
+			/* LOW after the leader is checked here as well */
+			analyzer_timing_add(azer, REMOCON_SYM_DATA_L,
+					    azer->dur, SONY_DATA_L_LEN_TYP);
 			return 0;
+		}
 	} else if (azer->state == ANALYZER_STATE_TRAILER)
 		return DETECTED_PATTERN_TRAILER;
 
@@ -80,8 +84,11 @@ static int sony_on_flip_dn(const analyzer_t *azer)
 {
 	if (azer->state == ANALYZER_STATE_LEADER) {
 		if ((azer->dur >= azer->cfg->leader_h_len_min) &&
-		    (azer->dur <= azer->cfg->leader_h_len_max))
+		    (azer->dur <= azer->cfg->leader_h_len_max)) {
+			analyzer_timing_add(azer, REMOCON_SYM_LEADER_H,
+					    azer->dur, SONY_LEADER_H_LEN_TYP);
 			return 0;
+		}
 	} else
 		return 0;
 
@@ -108,12 +115,18 @@ static int sony_on_each_sample(const analyzer_t *azer)
 			app_debug(ANALYZER, 2, "[%s] data0 (bit%d) at %d\n",
 				  azer->cfg->fmt_tag,
 				  azer->dst_idx, azer->src_idx);
+			analyzer_timing_add(azer, REMOCON_SYM_DATA0_H,
+					    azer->dur_prev,
+					    SONY_DATA0_H_LEN_TYP);
 			return DETECTED_PATTERN_DATA0;
 		} else if ((azer->dur_prev >= SONY_DATA1_H_LEN_MIN) &&
 			   (azer->dur_prev <= SONY_DATA1_H_LEN_MAX)) {
 			app_debug(ANALYZER, 2, "[%s] data1 (bit%d) at %d\n",
 				  azer->cfg->fmt_tag,
 				  azer->dst_idx, azer->src_idx);
+			analyzer_timing_add(azer, REMOCON_SYM_DATA1_H,
+					    azer->dur_prev,
+					    SONY_DATA1_H_LEN_TYP);
 			return DETECTED_PATTERN_DATA1;
 		}
 	} else
@@ -148,7 +161,8 @@ int sony_on_end_cycle(const analyzer_t *azer,
 		prod = ((unsigned short)buf[2] << 9) |
 		       ((unsigned short)buf[1] << 1) |
 		       (buf[0] >> 7);
-		sprintf(dst_str, "prod=%04x cmd=%02x", prod, cmd);
+		snprintf(dst_str, azer->dst_len, "prod=%04x cmd=%02x",
+			 prod, cmd);
 
 		memcpy(buf0, buf, azer->cfg->data_len);
 	} else {
@@ -233,5 +247,5 @@ int remocon_format_forge_sony(unsigned char *ptn, size_t sz,
 		forge_until(&fger, 0, t_start + SONY_CYCLE_LEN_TYP);
 	}
 
-	return 0;
+	return forger_len(&fger);
 }
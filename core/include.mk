@@ -1,5 +1,5 @@
 CC := gcc
-CFLAGS := -Wall -W -O2
+CFLAGS := -Wall -W -O2 -fPIC
 LDFLAGS :=
 
 CFLAGS += -DAPP_DEBUG
@@ -26,14 +26,23 @@
 #include <fcntl.h>
 #include <libgen.h>
 #include <errno.h>
-#include <termios.h>
+#include <signal.h>
+#include <time.h>
 #include <sys/stat.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include "lemon_corn_data.h"
+#include "lemon_corn_dev.h"
+#include "lemon_corn_async.h"
+#include "lemon_corn_loop.h"
+#include "lemon_corn_match.h"
+#include "lemon_corn_fcache.h"
+#include "lemon_corn_dlib.h"
+#include "lemon_corn_rle.h"
+#include "lemon_corn_ctl.h"
 #include "file_util.h"
 #include "string_util.h"
+#include "serial_util.h"
 #include "PC-OP-RS1.h"
 #include "lemon_squash.h"
 #include "format/remocon_format.h"
@@ -49,8 +58,10 @@
 #define PORT_STR		"26851"
 
 #define CMD_MAX			50
-#define BAUDRATE		B115200
 #define DATA_FN			"lemon_corn.data"
+#define FCACHE_FN		"lemon_corn.fcache"
+#define DLIB_FN			"lemon_corn.dlib"
+#define GAP_FN			"lemon_corn.gap"
 
 #define APP_MODE_TRANSMIT	0
 #define APP_MODE_RECEIVE	1
@@ -58,12 +69,28 @@
 #define APP_MODE_DELETE		3
 #define APP_MODE_FORGE		4
 #define APP_MODE_FORGE_TRANSMIT	5
+#define APP_MODE_MATCH		6
+#define APP_MODE_FORGE_BULK	7
+#define APP_MODE_UPLOAD		8
+#define APP_MODE_DAEMON		9
+
+#define UNKNOWN_TRAILER_MS	100	/* for the signals not analyzed */
+#define BURST_LEN_MAX		(255 * LEMON_SQUASH_DATA_UNIT_LEN)
+
+#define FORGE_BULK_BATCH	64	/* entries */
+#define FORGE_DATA_LEN_MAX	512	/* multiple of LEMON_SQUASH_DATA_UNIT_LEN */
 
 #define LIST_MODE_NONE		0
 #define LIST_MODE_HEX		1
 #define LIST_MODE_WAVE		2
 #define LIST_MODE_FORMATTED	3
 
+/* the gap after the command. "<tag> <gap_ms>" per line in GAP_FN */
+struct tag_gap {
+	char tag[LEMON_CORN_TAG_LEN];
+	int gap_ms;
+};
+
 static struct app {
 	const char *devname;
 	char *cmd[CMD_MAX + 1];
@@ -74,85 +101,87 @@ static struct app {
 	char *data_dir, *data_fn;
 	struct lcdata data;
 	char *forge_fmt;
+	const char *forge_bulk_fn;
+	struct lcfcache fcache;
+	int use_fcache;
+	char *fcache_fn;
+	struct lcdlib dlib;
+	char *dlib_fn;
+	struct tag_gap *gaps;
+	int n_gaps;
+	char *gap_fn;
+	int settle_ms;
+	long long tx_ready_ms;	/* the next frame can go after this */
+	long long sched_ms;	/* where the sequence is on its schedule */
 	size_t data_len, trunc_len;
+	int auto_trim;
 	int dont_save;
 	const char *proxy_host;
-	int is_arduino;
-	int is_virtual;
+	struct lcdev dev;
+	int baud;
+	int no_reset;
+	int dev_ready;
+	const char *ctl_path;
+	int use_pipeline;
+	int use_edge;
+	int burst_gap;		/* ms. -1 if not in burst mode */
+	int show_stats;
+	int match_k;
+	int use_lsh;
 } app;
 
-static int serial_open(const char *devname, struct termios *tio_old)
-{
-	struct termios tio_new;
-	int fd;
-
-	fd = open(devname, O_RDWR | O_NOCTTY);
-	if (fd < 0) {
-		app_error("device open failed: %s (%s)\n",
-			  devname, strerror(errno));
-		return -1;
-	}
-
-	tcgetattr(fd, tio_old);
-
-	tio_new.c_cflag = BAUDRATE | CS8 | CLOCAL | CREAD;
-	tio_new.c_iflag = 0;
-	tio_new.c_oflag = 0;
-	tio_new.c_lflag = 0;
-	tio_new.c_cc[VMIN] = 1;
-	tio_new.c_cc[VTIME] = 0;
-
-	tcflush(fd, TCIFLUSH);
-	tcsetattr(fd, TCSANOW, &tio_new);
-
-	return fd;
-}
-
-static int serial_close(int fd, const struct termios *tio_old)
-{
-	tcsetattr(fd, TCSANOW, tio_old);
-	return close(fd);
-}
-
-static int proxy_open(const char *host_name, const char *port_str)
-{
-	int fd;
-	struct addrinfo ai_hint, *aip;
-	int r;
-
-	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-		app_error("socket() failed\n");
-		return -1;
-	}
-
-	memset(&ai_hint, 0, sizeof(struct addrinfo));
-	ai_hint.ai_family = AF_INET;
-	ai_hint.ai_socktype = SOCK_STREAM;
-	ai_hint.ai_flags = 0;
-	ai_hint.ai_protocol = 0;
-
-	if ((r = getaddrinfo(host_name, port_str, &ai_hint, &aip)) < 0) {
-		app_error("getaddrinfo: %s\n", gai_strerror(r));
-		close(fd);
-		return -1;
-	}
+static volatile sig_atomic_t interrupted;
 
-	if (connect(fd, aip->ai_addr, aip->ai_addrlen) < 0) {
-		app_error("connect() failed\n");
-		close(fd);
-		freeaddrinfo(aip);
-		return -1;
-	}
+#define LINE_LEN		64
 
-	freeaddrinfo(aip);
+#define SLOT_FREE		0
+#define SLOT_READY		1	/* prepared. waiting for its turn */
+#define SLOT_BUSY		2	/* on the device */
+#define SLOT_SLEEP		3	/* _sleep in progress */
 
-	return fd;
-}
+/* a command on its way to the device */
+struct tx_slot {
+	struct lcasync_req req;
+	char cmd[LINE_LEN];
+	unsigned char *data;
+	size_t data_size;
+	int gap_ms;
+	long sleep_ms;		/* -1 if not _sleep */
+	int state;
+};
 
-static int proxy_close(int fd)
-{
-	return close(fd);
-}
+/*
+ * the event loop of the transmit and the receive
+ *
+ *   the device is driven by its I/O thread (lemon_corn_async.h), and
+ *   this thread waits on the loop for the completions, stdin and the
+ *   pacing timer.  the next command is looked up and analyzed, or the
+ *   last capture is decoded and stored, while the device is busy.
+ */
+static struct ev {
+	struct lcloop loop;
+	struct lcasync as;
+	struct lcloop_watch done_w, timer_w, stdin_w;
+	int timer_fd;
+	/* transmit */
+	struct tx_slot slot[2];	/* the head at @cur, and the one after */
+	int cur;
+	int is_interactive;
+	int next_cmd;		/* in app.cmd[] */
+	int in_eof;
+	int prompted;
+	int tx_failed;
+	char in_buf[LINE_LEN * 4];
+	size_t in_len;
+	char lines[CMD_MAX][LINE_LEN];
+	int line_head, n_lines;
+	/* receive */
+	struct lcasync_req rx_req[2];
+	unsigned char *rx_buf[2];
+	int rx_idx;		/* in app.cmd[] */
+	void *rx_p;		/* where the next entry goes */
+	int rx_failed;
+} ev;
 
 static char *hexdump(char *dst, const unsigned char *data, size_t sz)
 {
@@ -178,33 +207,131 @@ static char *wavedump(char *dst, const unsigned char *data, size_t sz)
 	return dst;
 }
 
-static int remocon_send(int fd, const unsigned char *data, size_t sz)
+/*
+ * print analyzed format of the data
+ * @dst_str needs (sz * 2 + 1) bytes at least
+ * returns 0 if the format is known, and fills @info
+ */
+static int print_format(char *dst_str, const unsigned char *data, size_t sz,
+			struct remocon_format_info *info)
 {
-	const unsigned char *rp;
-	int rest, wcnt;
+	struct remocon_format_info info_tmp;
+	char fmt_tag[32];
+
+	if (info == NULL)
+		info = &info_tmp;
+	if (remocon_format_analyze(fmt_tag, dst_str, sz * 2 + 1, data, sz,
+				   info) == 0) {
+		printf("format = %s, data = %s\n", fmt_tag, dst_str);
+		remocon_format_print_timing(stdout, info);
+		return 0;
+	} else {
+		hexdump(dst_str, data, sz);
+		printf("unknown format!\n%s\n", dst_str);
+		return -1;
+	}
+}
 
-	if (app.is_virtual)
-		return sz;
+static int print_format_runs(char *dst_str, size_t dst_len,
+			     const unsigned int *runs, int n_runs)
+{
+	struct remocon_format_info info;
+	char fmt_tag[32];
+	int i;
 
-	for (rp = data, rest = sz; rest; rp += wcnt, rest -= wcnt) {
-		wcnt = write(fd, rp, rest);
-		if (wcnt < 0) {
-			app_error("write error: %s\n", strerror(errno));
-			return wcnt;
-		}
+	if (remocon_format_analyze_runs(fmt_tag, dst_str, dst_len, runs, n_runs,
+					&info) == 0) {
+		printf("format = %s, data = %s\n", fmt_tag, dst_str);
+		remocon_format_print_timing(stdout, &info);
+		return 0;
 	}
 
-#if (DEBUG_LEVEL_LEMON_CORN >= 1)
+	printf("unknown format!\n");
+	for (i = 0; i < n_runs; i++)
+		printf("%c%u%s", (i & 1) ? '+' : '-', runs[i] * 100,
+		       ((i % 16 == 15) || (i == n_runs - 1)) ? "\n" : " ");
+	return -1;
+}
+
+/*
+ * returns 1 if both data are analyzed in the same way
+ */
+static int same_format(const unsigned char *data0, size_t sz0,
+		       const unsigned char *data1, size_t sz1)
 {
-	char s[sz * 2 + 1];
-	app_debug(LEMON_CORN, 1, "sent: %s\n", hexdump(s, data, sz));
+	char fmt_tag0[32], fmt_tag1[32];
+	char s0[sz0 * 2 + 1], s1[sz1 * 2 + 1];
+
+	if ((remocon_format_analyze(fmt_tag0, s0, sizeof(s0), data0, sz0,
+				    NULL) < 0) ||
+	    (remocon_format_analyze(fmt_tag1, s1, sizeof(s1), data1, sz1,
+				    NULL) < 0))
+		return 0;
+	return !strcmp(fmt_tag0, fmt_tag1) && !strcmp(s0, s1);
 }
-#endif
 
-	return sz;
+/*
+ * length to store the received data, trailing idle removed
+ * the trimmed data must be analyzed in the same way as the original one.
+ * otherwise, the whole data is kept.
+ */
+static size_t trim_len(const unsigned char *data, size_t sz, size_t sig_len)
+{
+	size_t len;
+
+	if (sig_len == 0)
+		return sz;
+	len = (sig_len + LEMON_SQUASH_DATA_UNIT_LEN - 1) /
+		LEMON_SQUASH_DATA_UNIT_LEN * LEMON_SQUASH_DATA_UNIT_LEN;
+	if (len >= sz)
+		return sz;
+
+	if (!same_format(data, sz, data, len)) {
+		app_debug(LEMON_CORN, 1, "can't trim the data to %zu bytes\n",
+			  len);
+		return sz;
+	}
+
+	return len;
 }
 
-static void save_cmd_with_new(const struct lcdata *new_lcdata)
+/*
+ * store the identical cycles just once into @dst (@sz bytes at least)
+ * returns the length stored, or 0 if it's not worth or not safe
+ */
+static size_t rep_factor(unsigned char *dst, const unsigned char *data,
+			 size_t sz, const struct remocon_format_info *info)
+{
+	struct lcdata_ent ent;
+	unsigned char expanded[sz];
+	size_t len;
+
+	if ((info->rep_count < 2) || (info->rep_count > 255))
+		return 0;
+
+	len = lcdata_rep_factor(dst, data, sz, info->rep_start,
+				info->rep_period, info->rep_count);
+	if (len + sizeof(struct lcdata_ent_img_rep) >=
+	    sz + sizeof(struct lcdata_ent_img_var))
+		return 0;
+
+	/* the expanded data must be analyzed in the same way */
+	ent.data = dst;
+	ent.data_size = sz;
+	ent.img_data_size = len;
+	ent.rep_start = info->rep_start;
+	ent.rep_period = info->rep_period;
+	ent.rep_count = info->rep_count;
+	lcdata_ent_expand(&ent, expanded);
+	if (!same_format(data, sz, expanded, sz)) {
+		app_debug(LEMON_CORN, 1, "can't factor the repeated cycles\n");
+		return 0;
+	}
+
+	return len;
+}
+
+static int save_cmd_with_new(const struct lcdata *new_lcdata)
 {
 	struct stat st;
 
@@ -212,473 +339,1620 @@ static void save_cmd_with_new(const struct lcdata *new_lcdata)
 		if (mkdir(app.data_dir, 0755) < 0) {
 			app_error("mkdir failed: %s (%s)\n",
 				  app.data_fn, strerror(errno));
-			return;
+			return -1;
 		}
 	}
-	lcdata_save(&app.data, app.data_fn);
-	if (new_lcdata)
-		lcdata_save_append(new_lcdata, app.data_fn);
+	if (lcdata_save(&app.data, app.data_fn) < 0)
+		return -1;
+	if (new_lcdata && (lcdata_save_append(new_lcdata, app.data_fn) < 0))
+		return -1;
 	printf("written new data to %s.\n", app.data_fn);
+	return 0;
 }
 
 #define save_cmd()	 save_cmd_with_new(NULL)
 
-static int remocon_read(int fd, unsigned char *data, size_t sz)
+static long long now_ms(void)
 {
-	unsigned char *rp;
-	int rest, rcnt;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
 
-	app_debug(LEMON_CORN, 1, "waiting for data...\n");
-	for (rp = data, rest = sz; rest; rp += rcnt, rest -= rcnt) {
-		rcnt = read(fd, rp, rest);
-		if (rcnt < 0) {
-			app_error("read error: %s\n", strerror(errno));
-			return rcnt;
+/*
+ * no file is not an error
+ */
+static int gap_load(const char *fn)
+{
+	FILE *fp;
+	char line[128];
+	int lineno = 0;
+
+	if ((fp = fopen(fn, "r")) == NULL)
+		return (errno == ENOENT) ? 0 : -1;
+
+	while (fgets(line, sizeof(line), fp)) {
+		struct tag_gap *gaps;
+		struct tag_gap tg;
+
+		lineno++;
+		strchomp(line);
+		if ((line[0] == '#') || (line[0] == '\0'))
+			continue;
+		memset(tg.tag, 0, LEMON_CORN_TAG_LEN);
+		if (sscanf(line, "%31s %d", tg.tag, &tg.gap_ms) != 2) {
+			app_error("%s:%d: invalid line\n", fn, lineno);
+			continue;
 		}
+		gaps = realloc(app.gaps, sizeof(*gaps) * (app.n_gaps + 1));
+		if (gaps == NULL) {
+			app_error("%s(): memory allocation failed.\n",
+				  __func__);
+			break;
+		}
+		app.gaps = gaps;
+		app.gaps[app.n_gaps++] = tg;
 	}
 
-#if (DEBUG_LEVEL_LEMON_CORN >= 1)
-{
-	char s[sz * 2 + 1];
-	app_debug(LEMON_CORN, 1, "read: %s\n", hexdump(s, data, sz));
+	fclose(fp);
+	return 0;
 }
-#endif
 
-	return sz;
+/*
+ * idle time to keep after the command
+ *
+ *   given in GAP_FN, or the rest of the protocol's trailer which is not
+ *   in the data, plus the settle time of the appliance.  the signal
+ *   itself is over when the device completes the transmit.
+ */
+static int cmd_gap_ms(const char *tag, const unsigned char *data, size_t sz)
+{
+	struct remocon_format_info info;
+	char fmt_tag[32];
+	char dst_str[sz * 2 + 1];
+	int gap = 0;
+	int i;
+
+	for (i = 0; i < app.n_gaps; i++)
+		if (!strcmp(app.gaps[i].tag, tag))
+			return app.gaps[i].gap_ms;
+
+	if (remocon_format_analyze(fmt_tag, dst_str, sizeof(dst_str), data, sz,
+				   &info) == 0) {
+		gap = lcdev_signal_ms(info.sig_cut);
+	} else {
+		int idle = 0;	/* trailing idle in the data in samples */
+
+		for (i = sz - 1; (i >= 0) && (data[i] == 0); i--)
+			idle += 8;
+		if (i >= 0)
+			idle += __builtin_clz(data[i]) - (32 - 8);
+		if (UNKNOWN_TRAILER_MS > idle / 10)
+			gap = UNKNOWN_TRAILER_MS - idle / 10;
+	}
+	app_debug(LEMON_CORN, 1, "%s: gap %d + %d ms\n", tag, gap,
+		  app.settle_ms);
+
+	return gap + app.settle_ms;
 }
 
-static int remocon_expect(int fd, unsigned char expect)
+/*
+ * sleep until @deadline_ms on CLOCK_MONOTONIC (see now_ms())
+ */
+static void sleep_until(long long deadline_ms)
 {
-	unsigned char c;
+	struct timespec ts;
 
-	if (app.is_virtual)
-		return 0;
+	ts.tv_sec = deadline_ms / 1000;
+	ts.tv_nsec = (deadline_ms % 1000) * 1000000;
+	while ((clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+		EINTR) && !interrupted)
+		;
+}
 
-	remocon_read(fd, &c, 1);
-	if (c != expect) {
-		app_error("expect '%c'(0x%02x), but got '%c'(0x%02x)\n",
-			  expect, expect, c, c);
-		return -1;
-	}
-	return 0;
+/*
+ * wait for the gap after the last frame
+ */
+static void pace(void)
+{
+	if (app.tx_ready_ms > now_ms())
+		sleep_until(app.tx_ready_ms);
 }
 
-static int remocon_expect2(int fd, unsigned char *expect_ary, int len)
+static int transmit_ent(struct lcdev *dev, const struct lcdata_ent *ent)
 {
-	unsigned char c;
-	char buf[256];
-	int i;
+	unsigned char data[ent->data_size];
+	int gap_ms;
+	int idx;
+	int r;
 
-	if (app.is_virtual)
-		return 0;
+	lcdata_ent_expand(ent, data);
+	gap_ms = cmd_gap_ms(ent->tag, data, ent->data_size);
+
+	/*
+	 * the device keeps the gap with -pipeline.  the waveform is always
+	 * sent, as a NAK for the index comes too late to fall back.
+	 */
+	if (app.use_pipeline)
+		return lcdev_pipe_transmit_data(dev, app.ch, data,
+						ent->data_size, gap_ms);
+
+	pace();
+	r = 1;
+	idx = lcdlib_lookup(&app.dlib, ent->tag, data, ent->data_size);
+	if (idx >= 0) {
+		r = lcdev_transmit_idx(dev, app.ch, idx,
+				       app.dlib.ents[idx].len);
+		if (r < 0)
+			return -1;
+		if (r > 0)
+			app_debug(LEMON_CORN, 1, "%s is not on the device\n",
+				  ent->tag);
+	}
+	if (r > 0)
+		r = lcdev_transmit(dev, app.ch, data, ent->data_size);
+	app.tx_ready_ms = now_ms() + gap_ms;
+	return r;
+}
 
-	remocon_read(fd, &c, 1);
-	for (i = 0; i < len; i++)
-		if (c == expect_ary[i])
-			return 0;
+/*
+ * _sleep<sec> or _sleep<msec>ms
+ * returns the time in ms, or -1 if bad
+ */
+static long sleep_ms(const char *cmd)
+{
+	char *endp;
+	long ms = strtol(&cmd[6], &endp, 10);
 
-	for (i = 0; i < len; i++)
-		strcatf(buf, " '%c'(0x%02x)", expect_ary[i], expect_ary[i]);
-	app_error("expect %s\n", buf);
-	app_error("but got '%c'(0x%02x)\n", c, c);
-	return -1;
+	if (!strcmp(endp, "ms"))
+		;
+	else if (*endp == '\0')
+		ms *= 1000;
+	else
+		ms = -1;
+	if (ms < 0)
+		app_error("bad sleep: %s\n", cmd);
+	return ms;
 }
 
-static int transmit(int fd, int ch, const unsigned char *data, size_t sz)
+static int transmit_cmd(struct lcdev *dev, const char *cmd)
 {
-	unsigned char c;
+	if (!strncmp(cmd, "_sleep", 6)) {
+		long ms = sleep_ms(cmd);
 
-	if (sz == PCOPRS1_DATA_LEN) {
-		c = PCOPRS1_CMD_TRANSMIT;
-		if (remocon_send(fd, &c, 1) < 0)
-			return -1;
-		if (remocon_expect(fd, PCOPRS1_CMD_OK) < 0)
-			return -1;
-		c = PCOPRS1_CMD_CHANNEL(ch);
-		if (remocon_send(fd, &c, 1) < 0)
-			return -1;
-		if (remocon_expect(fd, PCOPRS1_CMD_OK) < 0)
-			return -1;
-		if (remocon_send(fd, data, sz) < 0)
-			return -1;
-		if (remocon_expect(fd, PCOPRS1_CMD_DATA_COMPLETION) < 0)
+		if (ms < 0)
 			return -1;
+		lcdev_pipe_flush(dev);
+		/* from the schedule, not from the end of the last transmit */
+		app.sched_ms += ms;
+		printf("sleeping %ld ms ...\n", ms);
+		sleep_until(app.sched_ms);
 	} else {
-		if (sz % LEMON_SQUASH_DATA_UNIT_LEN != 0) {
-			app_error("invalid data len %d\n", sz);
+		struct lcdata_ent ent;
+
+		if (lcdata_get_cmd_by_tag(&app.data, cmd, &ent) < 0) {
+			app_error("Unknown command: %s\n", cmd);
 			return -1;
 		}
-		c = LEMON_SQUASH_CMD_TRANSMIT2;
-		if (remocon_send(fd, &c, 1) < 0)
-			return -1;
-		if (remocon_expect(fd, PCOPRS1_CMD_OK) < 0)
-			return -1;
-		c = sz / LEMON_SQUASH_DATA_UNIT_LEN;
-		if (remocon_send(fd, &c, 1) < 0)
-			return -1;
-		if (remocon_expect(fd, PCOPRS1_CMD_OK) < 0)
-			return -1;
-		c = PCOPRS1_CMD_CHANNEL(ch);
-		if (remocon_send(fd, &c, 1) < 0)
-			return -1;
-		if (remocon_expect(fd, PCOPRS1_CMD_OK) < 0)
-			return -1;
-		if (remocon_send(fd, data, sz) < 0)
-			return -1;
-		if (remocon_expect(fd, PCOPRS1_CMD_DATA_COMPLETION) < 0)
+		printf("transmitting %s ...\n", cmd);
+		if (transmit_ent(dev, &ent) < 0)
 			return -1;
 	}
 
 	return 0;
 }
 
-static int receive(int fd, unsigned char *data, size_t sz)
+/*
+ * send the burst built so far as one frame, then keep @gap_ms
+ */
+static int burst_flush(struct lcdev *dev, unsigned char *buf, size_t *len,
+		       int gap_ms)
 {
-	unsigned char c;
-	int read_len;
+	size_t sz;
+	int r;
 
-	if (sz == PCOPRS1_DATA_LEN) {
-		c = PCOPRS1_CMD_RECEIVE;
-		if (remocon_send(fd, &c, 1) < 0)
-			return -1;
-		if (remocon_expect(fd, PCOPRS1_CMD_OK) < 0)
-			return -1;
-		if (remocon_expect(fd, PCOPRS1_CMD_RECEIVE_DATA) < 0)
-			return -1;
-		if ((read_len = remocon_read(fd, data, sz)) < 0)
-			return -1;
-		if (remocon_expect(fd, PCOPRS1_CMD_DATA_COMPLETION) < 0)
-			return -1;
-	} else {
-		if (sz % LEMON_SQUASH_DATA_UNIT_LEN != 0) {
-			app_error("invalid data len %d\n", sz);
-			return -1;
+	if (*len == 0)
+		return 0;
+	sz = (*len + LEMON_SQUASH_DATA_UNIT_LEN - 1) /
+		LEMON_SQUASH_DATA_UNIT_LEN * LEMON_SQUASH_DATA_UNIT_LEN;
+	memset(buf + *len, 0, sz - *len);
+	*len = 0;
+
+	printf("transmitting a burst (%zu bytes) ...\n", sz);
+	if (app.use_pipeline)
+		return lcdev_pipe_transmit_data(dev, app.ch, buf, sz, gap_ms);
+	pace();
+	r = lcdev_transmit(dev, app.ch, buf, sz);
+	app.tx_ready_ms = now_ms() + gap_ms;
+	return r;
+}
+
+/*
+ * concatenate the commands with @app.burst_gap of idle in between, and
+ * send them in as few frames as possible (one unless BURST_LEN_MAX is
+ * exceeded).  _sleep splits the burst.
+ */
+static int transmit_burst(struct lcdev *dev)
+{
+	unsigned char buf[BURST_LEN_MAX];
+	size_t len = 0;
+	/* 1 bit per 100us. rounded up to bytes */
+	size_t gap_len = ((size_t)app.burst_gap * 10 + 7) / 8;
+	int r = 0;
+	int i;
+
+	for (i = 0; (i < app.cmd_cnt) && !interrupted; i++) {
+		const char *cmd = app.cmd[i];
+		struct lcdata_ent ent;
+
+		if (!strncmp(cmd, "_sleep", 6)) {
+			if (burst_flush(dev, buf, &len, 0) < 0)
+				r = -1;
+			if (transmit_cmd(dev, cmd) < 0)
+				r = -1;
+			continue;
 		}
-		c = LEMON_SQUASH_CMD_RECEIVE2;
-		if (remocon_send(fd, &c, 1) < 0)
-			return -1;
-		if (remocon_expect(fd, PCOPRS1_CMD_OK) < 0)
-			return -1;
-		c = sz / LEMON_SQUASH_DATA_UNIT_LEN;
-		if (remocon_send(fd, &c, 1) < 0)
-			return -1;
-		if (remocon_expect(fd, PCOPRS1_CMD_OK) < 0)
-			return -1;
-		if (remocon_expect(fd, PCOPRS1_CMD_RECEIVE_DATA) < 0)
-			return -1;
-		if ((read_len = remocon_read(fd, data, sz)) < 0)
-			return -1;
-		if (remocon_expect(fd, PCOPRS1_CMD_DATA_COMPLETION) < 0)
-			return -1;
+		if (lcdata_get_cmd_by_tag(&app.data, cmd, &ent) < 0) {
+			app_error("Unknown command: %s\n", cmd);
+			r = -1;
+			continue;
+		}
+		if (len && (len + gap_len + ent.data_size > BURST_LEN_MAX) &&
+		    (burst_flush(dev, buf, &len, app.burst_gap) < 0))
+			r = -1;
+		if (ent.data_size > BURST_LEN_MAX) {
+			app_error("too long command: %s\n", cmd);
+			r = -1;
+			continue;
+		}
+
+		if (len) {
+			memset(buf + len, 0, gap_len);
+			len += gap_len;
+		}
+		printf("adding %s ...\n", cmd);
+		lcdata_ent_expand(&ent, buf + len);
+		len += ent.data_size;
+	}
+	if (burst_flush(dev, buf, &len, 0) < 0)
+		r = -1;
+	return r;
+}
+
+/*
+ * returns -1 if any of the commands fails
+ */
+static int transmit_cmdline(struct lcdev *dev)
+{
+	int r = 0;
+	int i;
+
+	app.sched_ms = now_ms();
+	if (app.burst_gap >= 0)
+		return transmit_burst(dev);
+	for (i = 0; (i < app.cmd_cnt) && !interrupted; i++)
+		if (transmit_cmd(dev, app.cmd[i]) < 0)
+			r = -1;
+	return interrupted ? -1 : r;
+}
+
+static char *fgets_prompt(char *s, int size, FILE *stream)
+{
+	printf("> ");
+	return fgets(s, size, stream);
+}
+
+static void transmit_interactive(struct lcdev *dev)
+{
+	char s[64];
+
+	while (fgets_prompt(s, sizeof(s), stdin)) {
+		strchomp(s);
+		if (!strcmp(s, "quit"))
+			break;
+		app.sched_ms = now_ms();
+		if (transmit_cmd(dev, s) == 0)
+			printf("OK\n");
+	}
+}
+
+/*
+ * event loop (see struct ev)
+ */
+static int ev_open(struct lcdev *dev, void (*on_done)(struct lcloop_watch *),
+		   void (*on_timer)(struct lcloop_watch *))
+{
+	if (lcloop_init(&ev.loop) < 0)
+		return -1;
+	if ((ev.timer_fd = lcloop_timer_open()) < 0) {
+		lcloop_free(&ev.loop);
+		return -1;
 	}
+	if (lcasync_start(&ev.as, dev) < 0) {
+		close(ev.timer_fd);
+		lcloop_free(&ev.loop);
+		return -1;
+	}
+
+	ev.done_w.fd = ev.as.done_fd;
+	ev.done_w.cb = on_done;
+	ev.timer_w.fd = ev.timer_fd;
+	ev.timer_w.cb = on_timer;
+	if ((lcloop_add(&ev.loop, &ev.done_w) < 0) ||
+	    (on_timer && (lcloop_add(&ev.loop, &ev.timer_w) < 0))) {
+		app_error("epoll_ctl() failed: %s\n", strerror(errno));
+		lcasync_stop(&ev.as);
+		close(ev.timer_fd);
+		lcloop_free(&ev.loop);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * the request in progress is canceled by ^C, and completes before this
+ */
+static void ev_close(void)
+{
+	lcasync_stop(&ev.as);
+	close(ev.timer_fd);
+	lcloop_free(&ev.loop);
+}
+
+static void ev_run(void)
+{
+	while ((lcloop_run(&ev.loop) < 0) && (errno == EINTR) &&
+	       !interrupted)
+		;
+}
+
+/*
+ * transmit
+ */
+static const char *tx_next_cmd(void)
+{
+	const char *cmd;
+
+	if (!ev.is_interactive)
+		return (ev.next_cmd < app.cmd_cnt) ?
+		       app.cmd[ev.next_cmd++] : NULL;
+	if (ev.n_lines == 0)
+		return NULL;
+	cmd = ev.lines[ev.line_head];
+	ev.line_head = (ev.line_head + 1) % CMD_MAX;
+	ev.n_lines--;
+	return cmd;
+}
 
-	return read_len;
+static int tx_no_more_cmd(void)
+{
+	if (ev.is_interactive)
+		return ev.in_eof && (ev.n_lines == 0);
+	return ev.next_cmd == app.cmd_cnt;
 }
 
-static int transmit_cmd(int fd, const char *cmd)
+/*
+ * look up the command, and analyze it for the gap
+ */
+static int tx_prepare(struct tx_slot *s, const char *cmd)
 {
+	struct lcdata_ent ent;
+	int idx;
+
+	snprintf(s->cmd, sizeof(s->cmd), "%s", cmd);
 	if (!strncmp(cmd, "_sleep", 6)) {
-		int time = atoi(&cmd[6]);
-		printf("sleeping %d sec(s)...\n", time);
-		sleep(time);
+		if ((s->sleep_ms = sleep_ms(cmd)) < 0)
+			return -1;
+		s->state = SLOT_READY;
+		return 0;
+	}
+	s->sleep_ms = -1;
+
+	if (lcdata_get_cmd_by_tag(&app.data, cmd, &ent) < 0) {
+		app_error("Unknown command: %s\n", cmd);
+		return -1;
+	}
+	if ((s->data = malloc(ent.data_size)) == NULL) {
+		app_error("%s(): memory allocation failed.\n", __func__);
+		return -1;
+	}
+	lcdata_ent_expand(&ent, s->data);
+	s->data_size = ent.data_size;
+	idx = lcdlib_lookup(&app.dlib, ent.tag, s->data, ent.data_size);
+	s->gap_ms = cmd_gap_ms(ent.tag, s->data, ent.data_size);
+
+	memset(&s->req, 0, sizeof(s->req));
+	s->req.ch = app.ch;
+	if (idx >= 0) {
+		s->req.op = LCASYNC_OP_TRANSMIT_IDX;
+		s->req.idx = idx;
+		s->req.sz = app.dlib.ents[idx].len;
 	} else {
-		struct lcdata_ent ent;
+		s->req.op = LCASYNC_OP_TRANSMIT;
+		s->req.data = s->data;
+		s->req.sz = s->data_size;
+	}
+	s->state = SLOT_READY;
+	return 0;
+}
 
-		if (lcdata_get_cmd_by_tag(&app.data, cmd, &ent) < 0) {
-			app_error("Unknown command: %s\n", cmd);
+static void tx_fill(void)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		struct tx_slot *s = &ev.slot[(ev.cur + i) % 2];
+		const char *cmd;
+
+		while ((s->state == SLOT_FREE) && (cmd = tx_next_cmd()))
+			if (tx_prepare(s, cmd) < 0)
+				ev.tx_failed = 1;
+		if (s->state == SLOT_FREE)
+			return;
+	}
+}
+
+/*
+ * the head is done
+ */
+static void tx_retire(int ok)
+{
+	struct tx_slot *s = &ev.slot[ev.cur];
+
+	free(s->data);
+	s->data = NULL;
+	s->state = SLOT_FREE;
+	ev.cur = (ev.cur + 1) % 2;
+	if (!ok)
+		ev.tx_failed = 1;
+	else if (ev.is_interactive)
+		printf("OK\n");
+}
+
+/*
+ * start the head if its time has come, and prepare the next one
+ */
+static void tx_kick(void)
+{
+	struct tx_slot *s;
+	long long now;
+
+	if (interrupted) {
+		lcloop_quit(&ev.loop);
+		return;
+	}
+	tx_fill();
+
+	s = &ev.slot[ev.cur];
+	if (s->state == SLOT_FREE) {
+		if (tx_no_more_cmd()) {
+			lcloop_quit(&ev.loop);
+		} else if (!ev.prompted) {
+			printf("> ");
+			fflush(stdout);
+			ev.prompted = 1;
+		}
+		return;
+	}
+	if (s->state != SLOT_READY)
+		return;
+
+	now = now_ms();
+	if (s->sleep_ms >= 0) {
+		if (ev.is_interactive)
+			app.sched_ms = now;
+		/* from the schedule, not from the end of the last transmit */
+		app.sched_ms += s->sleep_ms;
+		printf("sleeping %ld ms ...\n", s->sleep_ms);
+		s->state = SLOT_SLEEP;
+		lcloop_timer_set(ev.timer_fd, app.sched_ms);
+		return;
+	}
+	if (app.tx_ready_ms > now) {
+		lcloop_timer_set(ev.timer_fd, app.tx_ready_ms);
+		return;
+	}
+
+	printf("transmitting %s ...\n", s->cmd);
+	s->state = SLOT_BUSY;
+	lcasync_submit(&ev.as, &s->req);
+	tx_fill();
+}
+
+static void tx_on_done(struct lcloop_watch *w)
+{
+	struct tx_slot *s = &ev.slot[ev.cur];
+
+	lcloop_drain(w->fd);
+	if ((s->state != SLOT_BUSY) || !lcasync_req_is_done(&s->req))
+		return;
+
+	/* an error may come after the signal. fall back only on a NAK */
+	if ((s->req.op == LCASYNC_OP_TRANSMIT_IDX) && (s->req.result > 0) &&
+	    !interrupted) {
+		app_debug(LEMON_CORN, 1, "%s is not on the device\n", s->cmd);
+		s->req.op = LCASYNC_OP_TRANSMIT;
+		s->req.data = s->data;
+		s->req.sz = s->data_size;
+		lcasync_submit(&ev.as, &s->req);
+		return;
+	}
+
+	app.tx_ready_ms = now_ms() + s->gap_ms;
+	tx_retire(s->req.result >= 0);
+	tx_kick();
+}
+
+static void tx_on_timer(struct lcloop_watch *w)
+{
+	lcloop_drain(w->fd);
+	if (ev.slot[ev.cur].state == SLOT_SLEEP)
+		tx_retire(1);
+	tx_kick();
+}
+
+static void tx_push_line(char *line)
+{
+	strchomp(line);
+	if (!strcmp(line, "quit")) {
+		ev.in_eof = 1;
+		return;
+	}
+	if (ev.n_lines == CMD_MAX) {
+		app_error("too many commands queued: %s\n", line);
+		return;
+	}
+	snprintf(ev.lines[(ev.line_head + ev.n_lines++) % CMD_MAX],
+		 LINE_LEN, "%s", line);
+	ev.prompted = 0;
+}
+
+static void tx_on_stdin(struct lcloop_watch *w)
+{
+	char *line, *nl;
+	ssize_t r;
+
+	r = read(w->fd, ev.in_buf + ev.in_len,
+		 sizeof(ev.in_buf) - 1 - ev.in_len);
+	if ((r < 0) && (errno == EINTR))
+		return;
+	if (r <= 0)
+		ev.in_eof = 1;
+	else
+		ev.in_len += r;
+	ev.in_buf[ev.in_len] = '\0';
+
+	for (line = ev.in_buf; !ev.in_eof && (nl = strchr(line, '\n'));
+	     line = nl + 1) {
+		nl[0] = '\0';
+		tx_push_line(line);
+	}
+	ev.in_len -= line - ev.in_buf;
+	memmove(ev.in_buf, line, ev.in_len);
+	if (ev.in_len == sizeof(ev.in_buf) - 1) {
+		app_error("too long line\n");
+		ev.in_len = 0;
+	}
+
+	if (ev.in_eof)
+		lcloop_del(&ev.loop, w);
+	tx_kick();
+}
+
+/*
+ * returns -1 if the loop can't be set up (stdin is a regular file etc.),
+ * and 1 if any of the commands fails
+ */
+static int transmit_loop(struct lcdev *dev)
+{
+	int i;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.is_interactive = (app.cmd_cnt == 0);
+	if (ev_open(dev, tx_on_done, tx_on_timer) < 0)
+		return -1;
+	if (ev.is_interactive) {
+		ev.stdin_w.fd = 0;
+		ev.stdin_w.cb = tx_on_stdin;
+		if (lcloop_add(&ev.loop, &ev.stdin_w) < 0) {
+			ev_close();
+			return -1;
+		}
+	}
+
+	app.sched_ms = now_ms();
+	tx_kick();
+	ev_run();
+
+	ev_close();
+	for (i = 0; i < 2; i++)
+		free(ev.slot[i].data);
+	return (ev.tx_failed || interrupted) ? 1 : 0;
+}
+
+/*
+ * the modes using the device are aborted if this fails
+ */
+static int device_setup(struct lcdev *dev)
+{
+	if (app.dev_ready)	/* kept open by the daemon */
+		return 0;
+
+	if (dev->is_arduino && !dev->is_virtual)
+		printf("wait for arduino serial setup...\n");
+	if (lcdev_setup(dev, app.baud) < 0)
+		return -1;
+	if (app.mode == APP_MODE_DAEMON)
+		app.dev_ready = 1;
+	return 0;
+}
+
+static int transmit_main(struct lcdev *dev)
+{
+	int r = 0;
+
+	if (device_setup(dev) < 0)
+		return -1;
+
+	/* -pipeline and -burst are paced by the device */
+	if (!app.use_pipeline && (app.burst_gap < 0) &&
+	    ((r = transmit_loop(dev)) >= 0))
+		return r ? -1 : 0;
+
+	if (app.cmd_cnt > 0)
+		r = transmit_cmdline(dev);
+	else
+		transmit_interactive(dev);
+	if (lcdev_pipe_flush(dev) < 0)
+		r = -1;
+	return r;
+}
+
+/*
+ * upload the commands to the device, and remember their indexes
+ */
+static int upload_main(struct lcdev *dev)
+{
+	struct lcdlib dlib;
+	unsigned char *img;
+	size_t img_size;
+	int r;
+
+	if (lcdlib_build(&dlib, &app.data, app.cmd, app.cmd_cnt,
+			 &img, &img_size) < 0)
+		return -1;
+
+	r = -1;
+	if (device_setup(dev) < 0)
+		goto out;
+
+	printf("uploading %d command(s) (%zu bytes) ...\n",
+	       app.cmd_cnt, img_size);
+	if ((r = lcdev_upload(dev, img, img_size)) < 0)
+		goto out;
+	if (r == 1) {
+		app_error("the image is too large for the device\n");
+		r = -1;
+		goto out;
+	}
+
+	if ((r = lcdlib_save(&dlib, app.dlib_fn)) == 0)
+		printf("written the device library to %s.\n", app.dlib_fn);
+
+out:
+	free(img);
+	return r;
+}
+
+static int delete_main(void)
+{
+	int r = 0;
+	int i;
+
+	for (i = 0; i < app.cmd_cnt; i++) {
+		if (lcdata_delete_by_tag(&app.data, app.cmd[i]) < 0) {
+			app_error("Unknown command: %s\n", app.cmd[i]);
+			r = -1;
+		} else {
+			printf("deleting %s\n", app.cmd[i]);
+		}
+	}
+	if (save_cmd() < 0)
+		r = -1;
+	return r;
+}
+
+/*
+ * store the capture for @cmd as an entry at @p
+ * returns the end of the entry
+ */
+static void *receive_store(void *p, const char *cmd, unsigned char *rbuf)
+{
+	struct remocon_format_info info;
+	char fmt_data_s[app.data_len * 2 + 1];
+	char *tag;
+	unsigned char *data;
+	unsigned char rep_buf[app.data_len];
+	size_t len, rep_len = 0;
+	int r;
+
+	if (app.trunc_len < app.data_len)
+		memset(rbuf + app.trunc_len, 0, app.data_len - app.trunc_len);
+
+	/* print received data format */
+	r = print_format(fmt_data_s, rbuf, app.data_len, &info);
+	len = app.data_len;
+	if (app.auto_trim && (r == 0)) {
+		len = trim_len(rbuf, app.data_len, info.sig_len);
+		rep_len = rep_factor(rep_buf, rbuf, len, &info);
+	}
+	if (len < app.data_len)
+		printf("trimmed to %zu bytes.\n", len);
+	if (rep_len)
+		printf("stored %d cycles as 1 (%zu bytes).\n",
+		       info.rep_count, rep_len);
+
+	if (rep_len) {
+		struct lcdata_ent_img_rep *rent =
+			(struct lcdata_ent_img_rep *)p;
+		lcdata_ent_img_rep_initialize(rent, rep_len, len,
+					      info.rep_start,
+					      info.rep_period,
+					      info.rep_count);
+		tag  = rent->tag;
+		data = rent->data;
+	} else if (len == PCOPRS1_DATA_LEN) {
+		struct lcdata_ent_img_fxd *fent =
+			(struct lcdata_ent_img_fxd *)p;
+		tag  = fent->tag;
+		data = fent->data;
+	} else {
+		struct lcdata_ent_img_var *vent =
+			(struct lcdata_ent_img_var *)p;
+		lcdata_ent_img_var_initialize(vent, len);
+		tag  = vent->tag;
+		data = vent->data;
+	}
+
+	lcdata_delete_by_tag(&app.data, cmd);
+
+	memset(tag, 0, LEMON_CORN_TAG_LEN);
+	strcpy(tag, cmd);
+	if (rep_len) {
+		memcpy(data, rep_buf, rep_len);
+		return data + rep_len;
+	}
+	memcpy(data, rbuf, len);
+	return data + len;
+}
+
+static void rx_submit(int i)
+{
+	struct lcasync_req *req = &ev.rx_req[i % 2];
+
+	memset(req, 0, sizeof(*req));
+	req->op = app.use_edge ? LCASYNC_OP_RECEIVE_EDGE : LCASYNC_OP_RECEIVE;
+	req->data = ev.rx_buf[i % 2];
+	req->sz = app.data_len;
+	lcasync_submit(&ev.as, req);
+}
+
+/*
+ * the device is armed for the next command before the capture is
+ * decoded and stored
+ */
+static void rx_on_done(struct lcloop_watch *w)
+{
+	int i = ev.rx_idx;
+	struct lcasync_req *req = &ev.rx_req[i % 2];
+
+	lcloop_drain(w->fd);
+	if (!lcasync_req_is_done(req))
+		return;
+	if ((req->result < 0) || interrupted) {
+		ev.rx_failed = 1;
+		lcloop_quit(&ev.loop);
+		return;
+	}
+
+	if (i + 1 < app.cmd_cnt)
+		rx_submit(i + 1);
+	ev.rx_p = receive_store(ev.rx_p, app.cmd[i], ev.rx_buf[i % 2]);
+	if (++ev.rx_idx == app.cmd_cnt) {
+		lcloop_quit(&ev.loop);
+		return;
+	}
+	printf("waiting ir data for %s ...\n", app.cmd[ev.rx_idx]);
+}
+
+/*
+ * receive app.cmd[] in order, and store them from *@p
+ */
+static int receive_loop(struct lcdev *dev, void **p)
+{
+	int i;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.rx_p = *p;
+	for (i = 0; i < 2; i++) {
+		if ((ev.rx_buf[i] = malloc(app.data_len)) == NULL) {
+			app_error("%s(): memory allocation failed.\n",
+				  __func__);
+			ev.rx_failed = 1;
+			goto out;
+		}
+	}
+	if (ev_open(dev, rx_on_done, NULL) < 0) {
+		ev.rx_failed = 1;
+		goto out;
+	}
+
+	printf("waiting ir data for %s ...\n", app.cmd[0]);
+	rx_submit(0);
+	ev_run();
+	if (interrupted)
+		ev.rx_failed = 1;
+	ev_close();
+
+out:
+	for (i = 0; i < 2; i++)
+		free(ev.rx_buf[i]);
+	*p = ev.rx_p;
+	return ev.rx_failed ? -1 : 0;
+}
+
+static int receive_main(struct lcdev *dev)
+{
+	struct lcdata new_lcdata;
+	unsigned char rbuf[app.data_len];
+	char fmt_data_s[app.data_len * 2 + 1];
+	void *p;
+	int r;
+
+	if (device_setup(dev) < 0)
+		return -1;
+
+	if (app.cmd_cnt == 0) {
+		// FIXME: merge with the below
+		printf("waiting ir data for ...\n");
+		if (app.use_edge) {
+			unsigned int runs[LCDEV_EDGE_RUN_MAX];
+			unsigned char rle[LCDEV_EDGE_RUN_MAX *
+					  LCRLE_VARINT_LEN_MAX];
+			size_t rle_len;
+
+			/* analyze the runs directly */
+			r = lcdev_receive_edge(dev, runs, LCDEV_EDGE_RUN_MAX,
+					       rle, &rle_len);
+			if (r > 0)
+				print_format_runs(fmt_data_s,
+						  sizeof(fmt_data_s), runs, r);
+			return (r > 0) ? 0 : -1;
+		}
+		r = lcdev_receive(dev, rbuf, app.data_len);
+		if (r < 0)
+			return -1;
+		if (app.trunc_len < app.data_len)
+			memset(rbuf + app.trunc_len, 0,
+			       app.data_len - app.trunc_len);
+
+		/* print received data format */
+		print_format(fmt_data_s, rbuf, app.data_len, NULL);
+		return 0;
+	}
+
+	/* enough for any entry type */
+	new_lcdata.img_size =
+		(sizeof(struct lcdata_ent_img_rep) + app.data_len) *
+		app.cmd_cnt;
+	new_lcdata.ent_img = malloc(new_lcdata.img_size);
+	if (new_lcdata.ent_img == NULL) {
+		app_error("memory allocation failed.\n");
+		return -1;
+	}
+
+	p = new_lcdata.ent_img;
+	if ((r = receive_loop(dev, &p)) < 0)
+		goto out;
+	new_lcdata.img_size = p - new_lcdata.ent_img;
+
+	/* data file write */
+	if (!app.dont_save)
+		r = save_cmd_with_new(&new_lcdata);
+
+out:
+	free(new_lcdata.ent_img);
+	return r;
+}
+
+static void list_main(void)
+{
+	void *p, *nextp, *endp;
+	struct lcdata_ent ent;
+
+	lcdata_for_each_entry(&app.data, &ent, p, nextp, endp) {
+		char *outbuf;
+		unsigned char data[ent.data_size];
+
+		if (app.cmd_cnt) {
+			int hit = 0;
+			int i;
+			for (i = 0; i < app.cmd_cnt; i++) {
+				if (!strcmp(app.cmd[i], ent.tag))
+					hit = 1;
+			}
+			if (!hit)
+				continue;
+		}
+		/* max size for LIST_MODE_WAVE */
+		outbuf = malloc(ent.data_size * 8 + 1);
+		lcdata_ent_expand(&ent, data);
+		switch (app.list_mode) {
+		case LIST_MODE_NONE:
+			printf("%s\n", ent.tag);
+			break;
+		case LIST_MODE_HEX:
+			hexdump(outbuf, data, ent.data_size);
+			printf("%s:\n%s\n", ent.tag, outbuf);
+			break;
+		case LIST_MODE_WAVE:
+			wavedump(outbuf, data, ent.data_size);
+			printf("%s:\n%s\n", ent.tag, outbuf);
+			break;
+		case LIST_MODE_FORMATTED:
+			printf("%s:\n", ent.tag);
+			print_format(outbuf, data, ent.data_size, NULL);
+			break;
+		}
+		free(outbuf);
+	}
+}
+
+static void print_match(const struct lcmatch_index *idx, const char *name,
+			const unsigned char *data, size_t sz)
+{
+	struct lcmatch_result res[app.match_k];
+	struct timespec t0, t1;
+	int n, i;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	n = lcmatch_query(idx, data, sz, res, app.match_k);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	printf("nearest to %s (%.1f us):\n", name,
+	       (t1.tv_sec - t0.tv_sec) * 1000000.0 +
+	       (t1.tv_nsec - t0.tv_nsec) / 1000.0);
+	for (i = 0; i < n; i++)
+		printf("  %2d: %-32s (distance = %d)\n",
+		       i + 1, res[i].tag, res[i].dist);
+}
+
+static int match_main(struct lcdev *dev)
+{
+	struct lcmatch_index idx;
+	int r = 0;
+	int i;
+
+	if (lcmatch_build(&idx, &app.data, app.use_lsh) < 0)
+		return -1;
+
+	if (app.cmd_cnt == 0) {
+		unsigned char rbuf[app.data_len];
+
+		if (device_setup(dev) < 0) {
+			lcmatch_free(&idx);
+			return -1;
+		}
+		printf("waiting ir data for ...\n");
+		if ((r = lcdev_receive(dev, rbuf, app.data_len)) >= 0)
+			print_match(&idx, "the received data",
+				    rbuf, app.data_len);
+	}
+
+	for (i = 0; i < app.cmd_cnt; i++) {
+		struct lcdata_ent ent;
+
+		if (lcdata_get_cmd_by_tag(&app.data, app.cmd[i], &ent) < 0) {
+			app_error("Unknown command: %s\n", app.cmd[i]);
+			r = -1;
+			continue;
+		}
+		{
+			unsigned char data[ent.data_size];
+
+			lcdata_ent_expand(&ent, data);
+			print_match(&idx, app.cmd[i], data, ent.data_size);
+		}
+	}
+
+	lcmatch_free(&idx);
+	return (r < 0) ? -1 : 0;
+}
+
+/*
+ * parse "FMT,custom,cmd"
+ * @fmt needs LCFCACHE_FMT_LEN bytes
+ */
+static int parse_forge_fmt(const char *str, char *fmt,
+			   unsigned long *custom, unsigned long *cmd)
+{
+	const char *p1, *p2;
+
+	for (p1 = str; *p1 != ','; p1++)
+		if (!*p1)
+			return -1;
+	if (p1 - str >= LCFCACHE_FMT_LEN)
+		return -1;
+	memset(fmt, 0, LCFCACHE_FMT_LEN);
+	memcpy(fmt, str, p1 - str);
+	p1++;
+	for (p2 = p1; *p2 != ','; p2++)
+		if (!*p2)
+			return -1;
+	p2++;
+
+	*custom = strtoul(p1, NULL, 16);
+	*cmd    = strtoul(p2, NULL, 16);
+	return 0;
+}
+
+/*
+ * returns the length of the forged signal in bytes
+ */
+static int forge_ptn(const char *fmt, unsigned long custom, unsigned long cmd,
+		     unsigned char *ptn, size_t sz)
+{
+	if (!strcmp(fmt, "AEHA"))
+		return remocon_format_forge_aeha(ptn, sz, custom, cmd);
+	else if (!strcmp(fmt, "NEC"))
+		return remocon_format_forge_nec(ptn, sz, (unsigned short)custom,
+						(unsigned char)cmd);
+	else if (!strcmp(fmt, "SONY"))
+		return remocon_format_forge_sony(ptn, sz, custom, cmd);
+	else if (!strcmp(fmt, "DKIN"))
+		return remocon_format_forge_dkin(ptn, sz, custom, cmd);
+	return -1;
+}
+
+/*
+ * forge the pattern, or copy it from the cache
+ * the cache keeps the signal part only.
+ */
+static int forge_cached(const char *fmt, unsigned long custom,
+			unsigned long cmd, unsigned char *ptn, size_t sz)
+{
+	const struct lcfcache_ent *fent;
+	int len;
+
+	fent = lcfcache_lookup(&app.fcache, fmt, custom, cmd);
+	if (fent && (fent->data_size <= sz)) {
+		app_debug(LEMON_CORN, 1, "forge cache hit: %s,%lx,%lx\n",
+			  fmt, custom, cmd);
+		memset(ptn, 0, sz);
+		memcpy(ptn, fent->data, fent->data_size);
+		return fent->data_size;
+	}
+
+	if ((len = forge_ptn(fmt, custom, cmd, ptn, sz)) < 0)
+		return -1;
+	lcfcache_insert(&app.fcache, fmt, custom, cmd, ptn,
+			((size_t)len < sz) ? (size_t)len : sz);
+	return len;
+}
+
+/*
+ * the length to store the forged signal of @sig_len bytes
+ * Arduino takes the signal rounded to LEMON_SQUASH_DATA_UNIT_LEN, which
+ * can be longer than PCOPRS1_DATA_LEN.  PC-OP-RS1 gets it padded to the
+ * fixed length by lcdev_transmit().
+ */
+static size_t forged_len(const unsigned char *ptn, size_t sig_len)
+{
+	size_t max = (app.dev.is_arduino && app.auto_trim) ?
+		     FORGE_DATA_LEN_MAX : PCOPRS1_DATA_LEN;
+
+	if (sig_len > max)
+		app_debug(LEMON_CORN, 1, "forged signal clipped (%zu bytes)\n",
+			  sig_len);
+	if (!app.auto_trim)
+		return max;
+	return trim_len(ptn, max, sig_len);
+}
+
+/*
+ * store the forged pattern as a new entry at @p
+ * returns the size of the entry
+ */
+static size_t put_forged_ent(void *p, const char *tag,
+			     const unsigned char *data, size_t len)
+{
+	char *dst_tag;
+	unsigned char *dst_data;
+
+	if (len == PCOPRS1_DATA_LEN) {
+		struct lcdata_ent_img_fxd *fent = p;
+		dst_tag  = fent->tag;
+		dst_data = fent->data;
+	} else {
+		struct lcdata_ent_img_var *vent = p;
+		lcdata_ent_img_var_initialize(vent, len);
+		dst_tag  = vent->tag;
+		dst_data = vent->data;
+	}
+	memset(dst_tag, 0, LEMON_CORN_TAG_LEN);
+	strcpy(dst_tag, tag);
+	memcpy(dst_data, data, len);
+
+	return dst_data + len - (unsigned char *)p;
+}
+
+static int fcache_open(void)
+{
+	if (lcfcache_init(&app.fcache, LCFCACHE_DEFAULT_SIZE) < 0)
+		return -1;
+	if (app.use_fcache)
+		lcfcache_load(&app.fcache, app.fcache_fn);
+	return 0;
+}
+
+static void fcache_close(void)
+{
+	struct stat st;
+
+	if (app.use_fcache && app.fcache.is_dirty) {
+		if ((stat(app.data_dir, &st) < 0) &&
+		    (mkdir(app.data_dir, 0755) < 0))
+			app_error("mkdir failed: %s (%s)\n",
+				  app.data_dir, strerror(errno));
+		else
+			lcfcache_save(&app.fcache, app.fcache_fn);
+	}
+	lcfcache_free(&app.fcache);
+}
+
+static int forge_main(struct lcdev *dev)
+{
+	unsigned char ptn[FORGE_DATA_LEN_MAX];
+	unsigned char new_ent_buf[sizeof(struct lcdata_ent_img_var) +
+				  FORGE_DATA_LEN_MAX];
+	struct lcdata new_lcdata = {
+		.img_size = 0,
+		.ent_img = new_ent_buf,
+	};
+	char fmt[LCFCACHE_FMT_LEN];
+	unsigned long custom, cmd;
+	int sig_len;
+	size_t len;
+
+	if (parse_forge_fmt(app.forge_fmt, fmt, &custom, &cmd) < 0)
+		goto format_err;
+	if (fcache_open() < 0)
+		return -1;
+	if ((sig_len = forge_cached(fmt, custom, cmd, ptn, sizeof(ptn))) < 0) {
+		fcache_close();
+		goto format_err;
+	}
+	fcache_close();
+	len = forged_len(ptn, sig_len);
+
+	/* data file write */
+	if (app.mode == APP_MODE_FORGE_TRANSMIT) {
+		if (device_setup(dev) < 0)
+			return -1;
+		printf("transmitting ...\n");
+		return lcdev_transmit(dev, app.ch, ptn, len);
+	} else {
+		char s[FORGE_DATA_LEN_MAX * 2 + 1];
+		hexdump(s, ptn, len);
+		puts(s);
+		lcdata_delete_by_tag(&app.data, app.cmd[0]);
+		new_lcdata.img_size =
+			put_forged_ent(new_ent_buf, app.cmd[0], ptn, len);
+		return save_cmd_with_new(&new_lcdata);
+	}
+
+format_err:
+	printf("invalid forge format\n");
+	return -1;
+}
+
+/*
+ * forge "tag,FMT,custom,cmd" lines, and save them at once
+ * the good lines are saved even if some are rejected, but it fails then.
+ */
+static int forge_bulk_main(void)
+{
+	struct lcdata new_lcdata = { .img_size = 0, .ent_img = NULL };
+	size_t img_alloc = 0;
+	FILE *fp;
+	char line[256];
+	int lineno = 0, n_ent = 0, n_bad = 0;
+	int r = -1;
+
+	if (!strcmp(app.forge_bulk_fn, "-"))
+		fp = stdin;
+	else if ((fp = fopen(app.forge_bulk_fn, "r")) == NULL) {
+		app_error("can't open %s (%s)\n",
+			  app.forge_bulk_fn, strerror(errno));
+		return -1;
+	}
+	if (fcache_open() < 0)
+		goto out;
+
+	while (fgets(line, sizeof(line), fp)) {
+		unsigned char ptn[FORGE_DATA_LEN_MAX];
+		char fmt[LCFCACHE_FMT_LEN];
+		unsigned long custom, cmd;
+		char *tag = line, *p;
+		int sig_len;
+		size_t len;
+
+		lineno++;
+		strchomp(line);
+		if ((line[0] == '\0') || (line[0] == '#'))
+			continue;
+		if (((p = strchr(line, ',')) == NULL) ||
+		    (p - tag >= LEMON_CORN_TAG_LEN) || (p == tag) ||
+		    (parse_forge_fmt(p + 1, fmt, &custom, &cmd) < 0)) {
+			app_error("%s:%d: invalid line\n",
+				  app.forge_bulk_fn, lineno);
+			n_bad++;
+			continue;
+		}
+		*p = '\0';
+
+		sig_len = forge_cached(fmt, custom, cmd, ptn, sizeof(ptn));
+		if (sig_len < 0) {
+			app_error("%s:%d: unknown format %s\n",
+				  app.forge_bulk_fn, lineno, fmt);
+			n_bad++;
+			continue;
+		}
+		len = forged_len(ptn, sig_len);
+
+		/* grow the image by a batch */
+		if (new_lcdata.img_size + sizeof(struct lcdata_ent_img_var) +
+		    len > img_alloc) {
+			void *img;
+
+			img_alloc += (sizeof(struct lcdata_ent_img_var) +
+				      FORGE_DATA_LEN_MAX) * FORGE_BULK_BATCH;
+			if ((img = realloc(new_lcdata.ent_img,
+					   img_alloc)) == NULL) {
+				app_error("memory allocation failed.\n");
+				goto out;
+			}
+			new_lcdata.ent_img = img;
+		}
+
+		/* the last one wins */
+		lcdata_delete_by_tag(&app.data, tag);
+		lcdata_delete_by_tag(&new_lcdata, tag);
+		new_lcdata.img_size +=
+			put_forged_ent(new_lcdata.ent_img + new_lcdata.img_size,
+				       tag, ptn, len);
+		n_ent++;
+	}
+
+	if (ferror(fp)) {
+		app_error("%s: read error\n", app.forge_bulk_fn);
+		goto out;
+	}
+
+	printf("forged %d command(s).\n", n_ent);
+	if (n_bad)
+		app_error("%d line(s) rejected\n", n_bad);
+	r = n_bad ? -1 : 0;
+	if (n_ent && (save_cmd_with_new(&new_lcdata) < 0))
+		r = -1;
+
+out:
+	fcache_close();
+	free(new_lcdata.ent_img);
+	if (fp != stdin)
+		fclose(fp);
+	return r;
+}
+
+/*
+ * what a command line or a daemon request can set.  every request
+ * starts from here, not from what the previous one left.
+ */
+static void reset_request_state(void)
+{
+	app.mode = APP_MODE_TRANSMIT;
+	memset(app.cmd, 0, sizeof(app.cmd));
+	app.cmd_cnt = 0;
+	app.list_mode = LIST_MODE_NONE;
+	app.forge_fmt = NULL;
+	app.dont_save = 0;
+	app.match_k = 5;
+}
+
+/*
+ * sanity check of what to do, shared with the daemon requests
+ */
+static int check_mode(void)
+{
+	if ((app.mode == APP_MODE_DELETE) && (app.cmd_cnt == 0))
+		return -1;
+	if (app.dont_save) {
+		if (app.mode != APP_MODE_RECEIVE) {
+			app_error("unrecognized -ns\n");
+			return -1;
+		}
+		if (app.cmd_cnt != 0) {
+			app_error("commmand specified with -ns\n");
+			return -1;
+		}
+	}
+	if (app.mode == APP_MODE_FORGE) {
+		if (app.cmd_cnt == 0) {
+			app.mode = APP_MODE_FORGE_TRANSMIT;
+		} else if (app.cmd_cnt > 1) {
+			app_error("too many commmands specified"
+				  " with -forge.\n");
+			return -1;
+		}
+	}
+	if (app.match_k < 1) {
+		app_error("bad number of commands to show (%d)\n",
+			  app.match_k);
+		return -1;
+	}
+	if ((app.ch < 1) || (app.ch > 4)) {
+		app_error("bad channel (%d)\n", app.ch);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * daemon  (see lemon_corn_ctl.h)
+ */
+/* the library is kept indexed by the tag while the daemon runs */
+static void data_reload(void)
+{
+	lcdata_free(&app.data);
+	lcdata_load(&app.data, app.data_fn);
+	lcdata_index(&app.data);
+}
+
+/*
+ * parse a request into the same state as parse_arg() does
+ * the strings in @req are used as they are.
+ */
+static int parse_request(char *req, int ch)
+{
+	char *saveptr;
+	char *arg;
+
+	reset_request_state();
+	app.ch = ch;
+
+	for (arg = strtok_r(req, " \t", &saveptr); arg;
+	     arg = strtok_r(NULL, " \t", &saveptr)) {
+		if (!strcmp(arg, "-r")) {
+			app.mode = APP_MODE_RECEIVE;
+		} else if (!strcmp(arg, "-cl")) {
+			app.mode = APP_MODE_LIST;
+			app.list_mode = LIST_MODE_NONE;
+		} else if (!strcmp(arg, "-l")) {
+			app.mode = APP_MODE_LIST;
+			app.list_mode = LIST_MODE_HEX;
+		} else if (!strcmp(arg, "-p")) {
+			app.mode = APP_MODE_LIST;
+			app.list_mode = LIST_MODE_WAVE;
+		} else if (!strcmp(arg, "-f")) {
+			app.mode = APP_MODE_LIST;
+			app.list_mode = LIST_MODE_FORMATTED;
+		} else if (!strcmp(arg, "-d")) {
+			app.mode = APP_MODE_DELETE;
+		} else if (!strcmp(arg, "-match")) {
+			app.mode = APP_MODE_MATCH;
+		} else if (!strcmp(arg, "-k")) {
+			if ((arg = strtok_r(NULL, " \t", &saveptr)) == NULL)
+				return -1;
+			app.match_k = atoi(arg);
+		} else if (!strcmp(arg, "-ns")) {
+			app.dont_save = 1;
+		} else if (!strcmp(arg, "-ch")) {
+			if ((arg = strtok_r(NULL, " \t", &saveptr)) == NULL)
+				return -1;
+			app.ch = atoi(arg);
+		} else if (!strcmp(arg, "-forge")) {
+			app.mode = APP_MODE_FORGE;
+			if ((arg = strtok_r(NULL, " \t", &saveptr)) == NULL)
+				return -1;
+			app.forge_fmt = arg;
+		} else if (arg[0] == '-') {
+			app_error("unrecognized %s\n", arg);
 			return -1;
+		} else {
+			if (app.cmd_cnt == CMD_MAX)
+				return -1;
+			app.cmd[app.cmd_cnt++] = arg;
 		}
-		printf("transmitting %s ...\n", cmd);
-		transmit(fd, app.ch, ent.data, ent.data_size);
-		usleep(500000);
 	}
 
+	if (check_mode() < 0)
+		return -1;
+	if ((app.mode == APP_MODE_TRANSMIT) && (app.cmd_cnt == 0))
+		return -1;	/* no interactive mode */
 	return 0;
 }
 
-static void transmit_cmdline(int fd)
-{
-	int i;
-
-	for (i = 0; i < app.cmd_cnt; i++)
-		transmit_cmd(fd, app.cmd[i]);
-}
-
-static char *fgets_prompt(char *s, int size, FILE *stream)
-{
-	printf("> ");
-	return fgets(s, size, stream);
-}
-
-static void transmit_interactive(int fd)
+static int daemon_exec(struct lcdev *dev, char *req, int ch)
 {
-	char s[64];
+	int r = 0;
 
-	while (fgets_prompt(s, sizeof(s), stdin)) {
-		strchomp(s);
-		if (!strcmp(s, "quit"))
-			break;
-		if (transmit_cmd(fd, s) == 0)
-			printf("OK\n");
+	if (parse_request(req, ch) < 0) {
+		app_error("bad request\n");
+		return LCCTL_STATUS_BAD_REQ;
 	}
-}
 
-static void transmit_main(int fd)
-{
-	unsigned char c;
-	unsigned char ex_ary[2];
-
-	if (app.is_arduino) {	/* need serial setup time */
-		printf("wait for arduino serial setup...\n");
-		sleep(2);
+	switch (app.mode) {
+	case APP_MODE_TRANSMIT:
+		r = transmit_cmdline(dev);
+		if (lcdev_pipe_flush(dev) < 0)
+			r = -1;
+		break;
+	case APP_MODE_RECEIVE:
+		r = receive_main(dev);
+		data_reload();
+		break;
+	case APP_MODE_LIST:
+		list_main();
+		break;
+	case APP_MODE_DELETE:
+		r = delete_main();
+		data_reload();
+		break;
+	case APP_MODE_FORGE:
+	case APP_MODE_FORGE_TRANSMIT:
+		r = forge_main(dev);
+		if (app.mode == APP_MODE_FORGE)
+			data_reload();
+		break;
+	case APP_MODE_MATCH:
+		r = match_main(dev);
+		break;
 	}
-	c = PCOPRS1_CMD_LED;
-	remocon_send(fd, &c, 1);
-	ex_ary[0] = PCOPRS1_CMD_LED_OK;
-	ex_ary[1] = PCOPRS1_CMD_OK;
-	remocon_expect2(fd, ex_ary, sizeof(ex_ary));
 
-	if (app.cmd_cnt > 0)
-		transmit_cmdline(fd);
-	else
-		transmit_interactive(fd);
+	app.mode = APP_MODE_DAEMON;
+	return (r < 0) ? LCCTL_STATUS_FAILED : LCCTL_STATUS_OK;
 }
 
-static void delete_main(void)
+/*
+ * handle a request with the output redirected to the client
+ */
+static void daemon_serve(struct lcdev *dev, int cfd, int ch)
 {
-	int i;
-
-	for (i = 0; i < app.cmd_cnt; i++) {
-		if (lcdata_delete_by_tag(&app.data, app.cmd[i]) < 0)
-			app_error("Unknown command: %s\n", app.cmd[i]);
-		else
-			printf("deleting %s\n", app.cmd[i]);
+	char req[LCCTL_REQ_LEN_MAX];
+	unsigned char trailer[2];
+	long long deadline = now_ms() + LCCTL_REQ_TIMEOUT_MS;
+	size_t len = 0;
+	int out_fd, err_fd;
+
+	/*
+	 * the requests are served one at a time, so a client that trickles
+	 * its line must not hold the others for long.
+	 */
+	while (1) {
+		long long rest = deadline - now_ms();
+		unsigned char c;
+		int r;
+
+		r = serial_read_timeout(cfd, &c, 1, (rest > 0) ? rest : 0);
+		if (r == 0)
+			app_error("request timed out\n");
+		if (r != 1)
+			return;
+		if (c == '\n')
+			break;
+		if (len == sizeof(req) - 1)
+			return;
+		req[len++] = c;
 	}
-	save_cmd();
+	req[len] = '\0';
+	printf("request: %s\n", req);
+
+	fflush(stdout);
+	fflush(stderr);
+	out_fd = dup(1);
+	err_fd = dup(2);
+	dup2(cfd, 1);
+	dup2(cfd, 2);
+
+	trailer[0] = '\0';
+	trailer[1] = daemon_exec(dev, req, ch);
+
+	fflush(stdout);
+	fflush(stderr);
+	dup2(out_fd, 1);
+	dup2(err_fd, 2);
+	close(out_fd);
+	close(err_fd);
+
+	if (write(cfd, trailer, sizeof(trailer)) < 0)
+		app_error("write error: %s\n", strerror(errno));
 }
 
-static void receive_main(int fd)
+static int daemon_main(struct lcdev *dev)
 {
-	struct lcdata new_lcdata;
-	size_t ent_img_struct_size;
-	unsigned char c;
-	unsigned char ex_ary[2];
-	unsigned char rbuf[app.data_len];
-	char fmt_tag_s[32];
-	char fmt_data_s[app.data_len * 2 + 1];
-	void *p;
+	struct sockaddr_un sa;
+	int ch = app.ch;
+	mode_t old_mask;
+	int sfd;
 	int r;
-	int i;
-
-	if (app.is_arduino) {	/* need serial setup time */
-		printf("wait for arduino serial setup...\n");
-		sleep(2);
-	}
-	c = PCOPRS1_CMD_LED;
-	remocon_send(fd, &c, 1);
-	ex_ary[0] = PCOPRS1_CMD_LED_OK;
-	ex_ary[1] = PCOPRS1_CMD_OK;
-	remocon_expect2(fd, ex_ary, sizeof(ex_ary));
 
-	if (app.cmd_cnt == 0) {
-		// FIXME: merge with the below
-		printf("waiting ir data for ...\n");
-		r = receive(fd, rbuf, app.data_len);
-		if (r < 0)
-			return;
-		if (app.trunc_len < app.data_len)
-			memset(rbuf + app.trunc_len, 0,
-			       app.data_len - app.trunc_len);
+	if (device_setup(dev) < 0)
+		return -1;
+	lcdata_index(&app.data);
 
-		/* print received data format */
-		if (remocon_format_analyze(fmt_tag_s, fmt_data_s,
-					   rbuf, app.data_len) == 0) {
-			printf("format = %s, data = %s\n",
-			       fmt_tag_s, fmt_data_s);
-		} else {
-			hexdump(fmt_data_s, rbuf, app.data_len);
-			printf("unknown format!\n%s\n", fmt_data_s);
-		}
-		return;
+	if ((sfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		app_error("socket() failed\n");
+		return -1;
 	}
-
-	ent_img_struct_size =
-		(app.data_len == PCOPRS1_DATA_LEN) ?
-			sizeof(struct lcdata_ent_img_fxd) :
-			sizeof(struct lcdata_ent_img_var);
-	new_lcdata.img_size =
-		(ent_img_struct_size + app.data_len) * app.cmd_cnt;
-	new_lcdata.ent_img = malloc(new_lcdata.img_size);
-	if (new_lcdata.ent_img == NULL) {
-		app_error("memory allocation failed.\n");
-		return;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strncpy(sa.sun_path, app.ctl_path, sizeof(sa.sun_path) - 1);
+	unlink(app.ctl_path);
+	/* only the owner can control the device and overwrite the data */
+	old_mask = umask(0177);
+	r = bind(sfd, (struct sockaddr *)&sa, sizeof(sa));
+	umask(old_mask);
+	if ((r < 0) || (listen(sfd, 4) < 0)) {
+		app_error("bind failed: %s (%s)\n", app.ctl_path,
+			  strerror(errno));
+		close(sfd);
+		return -1;
 	}
 
-	p = new_lcdata.ent_img;
-	for (i = 0; i < app.cmd_cnt; i++) {
-		char *tag;
-		unsigned char *data;
-
-		if (app.data_len == PCOPRS1_DATA_LEN) {
-			struct lcdata_ent_img_fxd *fent =
-				(struct lcdata_ent_img_fxd *)p;
-			tag  = fent->tag;
-			data = fent->data;
-		} else {
-			struct lcdata_ent_img_var *vent =
-				(struct lcdata_ent_img_var *)p;
-			lcdata_ent_img_var_initialize(vent, app.data_len);
-			tag  = vent->tag;
-			data = vent->data;
-		}
+	/* the output goes to the client as it is produced */
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	signal(SIGPIPE, SIG_IGN);
+	printf("listening on %s\n", app.ctl_path);
 
-		lcdata_delete_by_tag(&app.data, app.cmd[i]);
-
-		memset(tag, 0, LEMON_CORN_TAG_LEN);
-		strcpy(tag, app.cmd[i]);
-
-		printf("waiting ir data for %s ...\n", app.cmd[i]);
-		r = receive(fd, rbuf, app.data_len);
-		if (r < 0)
-			goto out;
-		if (app.trunc_len < app.data_len)
-			memset(rbuf + app.trunc_len, 0,
-			       app.data_len - app.trunc_len);
+	while (!interrupted) {
+		int cfd = accept(sfd, NULL, NULL);
 
-		/* print received data format */
-		if (remocon_format_analyze(fmt_tag_s, fmt_data_s,
-					   rbuf, app.data_len) == 0) {
-			printf("format = %s, data = %s\n",
-			       fmt_tag_s, fmt_data_s);
-		} else {
-			hexdump(fmt_data_s, rbuf, app.data_len);
-			printf("unknown format!\n%s\n", fmt_data_s);
+		if (cfd < 0) {
+			if (errno == EINTR)
+				continue;
+			app_error("accept() failed: %s\n", strerror(errno));
+			break;
 		}
-		memcpy(data, rbuf, app.data_len);
-		p = data + app.data_len;
+		daemon_serve(dev, cfd, ch);
+		close(cfd);
 	}
 
-	/* data file write */
-	if (!app.dont_save)
-		save_cmd_with_new(&new_lcdata);
-
-out:
-	free(new_lcdata.ent_img);
+	close(sfd);
+	unlink(app.ctl_path);
+	return 0;
 }
 
-static void list_main(void)
+static void handler(int signo)
 {
-	void *p, *nextp, *endp;
-	struct lcdata_ent ent;
-
-	lcdata_for_each_entry(&app.data, &ent, p, nextp, endp) {
-		char fmt_tag[32];
-		char *outbuf;
-
-		/* max size for LIST_MODE_WAVE */
-		outbuf = malloc(ent.data_size * 8 + 1);
-		if (app.cmd_cnt) {
-			int hit = 0;
-			int i;
-			for (i = 0; i < app.cmd_cnt; i++) {
-				if (!strcmp(app.cmd[i], ent.tag))
-					hit = 1;
-			}
-			if (!hit)
-				continue;
-		}
-		switch (app.list_mode) {
-		case LIST_MODE_NONE:
-			printf("%s\n", ent.tag);
-			break;
-		case LIST_MODE_HEX:
-			hexdump(outbuf, ent.data, ent.data_size);
-			printf("%s:\n%s\n", ent.tag, outbuf);
-			break;
-		case LIST_MODE_WAVE:
-			wavedump(outbuf, ent.data, ent.data_size);
-			printf("%s:\n%s\n", ent.tag, outbuf);
-			break;
-		case LIST_MODE_FORMATTED:
-			printf("%s:\n", ent.tag);
-			if (remocon_format_analyze(fmt_tag, outbuf,
-						   ent.data,
-						   ent.data_size) == 0) {
-				printf("format = %s, data = %s\n",
-				       fmt_tag, outbuf);
-			} else {
-				hexdump(outbuf, ent.data, ent.data_size);
-				printf("unknown format!\n%s\n", outbuf);
-			}
-			break;
-		}
-		free(outbuf);
-	}
+	(void)signo;
+	interrupted = 1;
+	lcdev_cancel(&app.dev);
 }
 
-static void forge_main(int fd)
+/*
+ * ^C interrupts the pending exchange, which is canceled then
+ */
+static void setup_signal(void)
 {
-	struct lcdata_ent_img_fxd new_ent_img;
-	struct lcdata new_lcdata = {
-		.img_size = sizeof(struct lcdata_ent_img_fxd),
-		.ent_img = &new_ent_img,
-	};
-	char *p0, *p1, *p2;
-
-	p0 = app.forge_fmt;
-	for (p1 = p0; *p1 != ','; p1++)
-		if (!*p1)
-			goto format_err;
-	p1++;
-	for (p2 = p1; *p2 != ','; p2++)
-		if (!*p2)
-			goto format_err;
-	p2++;
-
-	memset(new_ent_img.tag, 0, LEMON_CORN_TAG_LEN);
-	if (app.mode == APP_MODE_FORGE) {
-		lcdata_delete_by_tag(&app.data, app.cmd[0]);
-		strcpy(new_ent_img.tag, app.cmd[0]);
-	}
-
-	if (!strncmp(p0, "AEHA,", p1 - p0)) {
-		unsigned long custom, cmd;
-		custom = strtol(p1, NULL, 16);
-		cmd    = strtol(p2, NULL, 16);
-		remocon_format_forge_aeha(new_ent_img.data, PCOPRS1_DATA_LEN,
-					  custom, cmd);
-	} else if (!strncmp(p0, "NEC,", p1 - p0)) {
-		unsigned long custom, cmd;
-		custom = strtol(p1, NULL, 16);
-		cmd    = strtol(p2, NULL, 16);
-		remocon_format_forge_nec(new_ent_img.data, PCOPRS1_DATA_LEN,
-					 (unsigned short)custom,
-					 (unsigned char)cmd);
-	} else if (!strncmp(p0, "SONY,", p1 - p0)) {
-		unsigned long prod, cmd;
-		prod = strtol(p1, NULL, 16);
-		cmd  = strtol(p2, NULL, 16);
-		remocon_format_forge_sony(new_ent_img.data, PCOPRS1_DATA_LEN,
-					  prod, cmd);
-	} else {
-		goto format_err;
-	}
-
-	/* data file write */
-	if (app.mode == APP_MODE_FORGE_TRANSMIT) {
-		printf("transmitting ...\n");
-		transmit(fd, app.ch, new_ent_img.data, PCOPRS1_DATA_LEN);
-	} else {
-		char s[PCOPRS1_DATA_LEN * 2 + 1];
-		hexdump(s, new_ent_img.data, PCOPRS1_DATA_LEN);
-		puts(s);
-		save_cmd_with_new(&new_lcdata);
-	}
-
-	return;
-
-format_err:
-	printf("invalid forge format\n");
+	struct sigaction sigact;
+
+	memset(&sigact, 0, sizeof(sigact));
+	sigact.sa_handler = handler;
+	sigemptyset(&sigact.sa_mask);
+	sigact.sa_flags = SA_RESETHAND;	/* no SA_RESTART */
+	sigaction(SIGINT, &sigact, NULL);
+	sigaction(SIGTERM, &sigact, NULL);
 }
 
 static void usage(const char *cmd_path)
@@ -693,20 +1967,53 @@ static void usage(const char *cmd_path)
 "        [-p]                 (list with waveform)\n"
 "        [-f]                 (list with format analysis)\n"
 "        [-d <command(s)>]    (delete)\n"
+"        [-match [<command(s)>]]  (find similar commands to received data\n"
+"                                  or to the given commands)\n"
+"        [-k <num>]           (number of commands to show with -match)\n"
+"        [-lsh]               (use LSH prefilter with -match)\n"
 "        [command(s)]         (send)\n"
 "        [-ns]                (do not save with -r)\n"
 "        [-s <serial device>] (default is " DEFAULT_TTY_DEV ")\n"
 "        [-ch <channel>]      (default is 1)\n"
 "        [-dd <data_dir>]     (searches default locations if not specified)\n"
 "        [-len <data_len>]    (data length to receive)\n"
-"        [-trunc <trunc_len>] (truncate received signal)\n"
+"        [-trunc <trunc_len>] (truncate received signal.\n"
+"                              trailing idle is trimmed if not specified)\n"
 "        [-forge <format> [<command>]]  (forge command with known format)\n"
 "                 format: AEHA,<custom_hex>,<cmd_hex>\n"
 "                         NEC,<custom_hex>,<cmd_hex>\n"
 "                         SONY,<prod_hex>,<cmd_hex>\n"
+"                         DKIN,<custom_hex>,<cmd_hex>\n"
+"        [-forge_bulk <file>] (forge \"<command>,<format>\" lines in <file>.\n"
+"                              - for stdin)\n"
+"        [-fcache]            (keep forged patterns in " FCACHE_FN ")\n"
 "        [-arduino]           (arduino mode)\n"
+"        [-baud <rate>]       (switch to <rate> if the device supports it.\n"
+"                              needs -arduino)\n"
+"        [-settle <ms>]       (idle time the appliance needs after\n"
+"                              each command. see " GAP_FN " also)\n"
+"        [-noreset]           (keep the device from resetting on the next\n"
+"                              open. needs -arduino)\n"
+"        [-burst <gap_ms>]    (send the commands in one frame with\n"
+"                              <gap_ms> of idle in between. needs -arduino)\n"
+"        [-upload <command(s)>]  (store the commands in the device.\n"
+"                                 they are sent by index later.\n"
+"                                 needs -arduino)\n"
+"        [-rle]               (send run-length coded waveforms.\n"
+"                              needs -arduino)\n"
+"        [-edge]              (receive the edges streamed by the device.\n"
+"                              needs -arduino)\n"
+"        [-idle <ms>]         (end receiving after <ms> of idle following\n"
+"                              the signal. needs -arduino)\n"
+"        [-timeout <sec>]     (give up receiving if no signal comes in\n"
+"                              <sec>)\n"
+"        [-pipeline]          (send commands without waiting for each\n"
+"                              one to complete. needs -arduino)\n"
+"        [-daemon <socket>]   (keep the device open, and serve the\n"
+"                              requests of lemon_corn_client on <socket>)\n"
 "        [-proxy <host>]      (specify serial proxy)\n"
 "        [-virtual]           (virtual mode)\n"
+"        [-stats]             (show format analyzer statistics)\n"
 "        [-h]                 (help)\n",
 		basename(cpy_path));
 	free(cpy_path);
@@ -728,15 +2035,26 @@ static int parse_arg(int argc, char *argv[])
 	app.data_dir = NULL;
 	app.devname = NULL;
 	app.ch = 1;
-	app.mode = APP_MODE_TRANSMIT;
-	memset(app.cmd, 0, sizeof(app.cmd));
-	app.cmd_cnt = 0;
+	reset_request_state();
 	app.data_len = PCOPRS1_DATA_LEN;
 	app.trunc_len = PCOPRS1_DATA_LEN;
-	app.dont_save = 0;
+	app.auto_trim = 1;
+	app.use_fcache = 0;
 	app.proxy_host = NULL;
-	app.is_arduino = 0;
-	app.is_virtual = 0;
+	lcdev_init(&app.dev);
+	app.baud = SERIAL_BAUD_DEFAULT;
+	app.no_reset = 0;
+	app.dev_ready = 0;
+	app.ctl_path = NULL;
+	app.settle_ms = 0;
+	app.gaps = NULL;
+	app.n_gaps = 0;
+	app.tx_ready_ms = 0;
+	app.use_pipeline = 0;
+	app.use_edge = 0;
+	app.burst_gap = -1;
+	app.show_stats = 0;
+	app.use_lsh = 0;
 
 	for (i = 1; i < argc; i++) {
 		if (!strcmp(argv[i], "-s")) {
@@ -759,6 +2077,14 @@ static int parse_arg(int argc, char *argv[])
 			app.list_mode = LIST_MODE_FORMATTED;
 		} else if (!strcmp(argv[i], "-d")) {
 			app.mode = APP_MODE_DELETE;
+		} else if (!strcmp(argv[i], "-match")) {
+			app.mode = APP_MODE_MATCH;
+		} else if (!strcmp(argv[i], "-k")) {
+			if (++i == argc)
+				return -1;
+			app.match_k = atoi(argv[i]);
+		} else if (!strcmp(argv[i], "-lsh")) {
+			app.use_lsh = 1;
 		} else if (!strcmp(argv[i], "-ns")) {
 			app.dont_save = 1;
 		} else if (!strcmp(argv[i], "-ch")) {
@@ -778,19 +2104,64 @@ static int parse_arg(int argc, char *argv[])
 			if (++i == argc)
 				return -1;
 			app.trunc_len = atoi(argv[i]);
+			app.auto_trim = 0;
 		} else if (!strcmp(argv[i], "-forge")) {
 			app.mode = APP_MODE_FORGE;
 			if (++i == argc)
 				return -1;
 			app.forge_fmt = argv[i];
+		} else if (!strcmp(argv[i], "-forge_bulk")) {
+			app.mode = APP_MODE_FORGE_BULK;
+			if (++i == argc)
+				return -1;
+			app.forge_bulk_fn = argv[i];
+		} else if (!strcmp(argv[i], "-fcache")) {
+			app.use_fcache = 1;
 		} else if (!strcmp(argv[i], "-proxy")) {
 			if (++i == argc)
 				return -1;
 			app.proxy_host = argv[i];
 		} else if (!strcmp(argv[i], "-arduino")) {
-			app.is_arduino = 1;
+			app.dev.is_arduino = 1;
+		} else if (!strcmp(argv[i], "-baud")) {
+			if (++i == argc)
+				return -1;
+			app.baud = atoi(argv[i]);
+		} else if (!strcmp(argv[i], "-settle")) {
+			if (++i == argc)
+				return -1;
+			app.settle_ms = atoi(argv[i]);
+		} else if (!strcmp(argv[i], "-noreset")) {
+			app.no_reset = 1;
+		} else if (!strcmp(argv[i], "-burst")) {
+			if (++i == argc)
+				return -1;
+			app.burst_gap = atoi(argv[i]);
+		} else if (!strcmp(argv[i], "-daemon")) {
+			app.mode = APP_MODE_DAEMON;
+			if (++i == argc)
+				return -1;
+			app.ctl_path = argv[i];
+		} else if (!strcmp(argv[i], "-upload")) {
+			app.mode = APP_MODE_UPLOAD;
+		} else if (!strcmp(argv[i], "-rle")) {
+			app.dev.use_rle = 1;
+		} else if (!strcmp(argv[i], "-timeout")) {
+			if (++i == argc)
+				return -1;
+			app.dev.rcv_timeout_ms = atoi(argv[i]) * 1000;
+		} else if (!strcmp(argv[i], "-idle")) {
+			if (++i == argc)
+				return -1;
+			app.dev.idle_ms = atoi(argv[i]);
+		} else if (!strcmp(argv[i], "-edge")) {
+			app.use_edge = 1;
+		} else if (!strcmp(argv[i], "-pipeline")) {
+			app.use_pipeline = 1;
 		} else if (!strcmp(argv[i], "-virtual")) {
-			app.is_virtual = 1;
+			app.dev.is_virtual = 1;
+		} else if (!strcmp(argv[i], "-stats")) {
+			app.show_stats = 1;
 		} else if (!strcmp(argv[i], "-h")) {
 			return 1;
 		} else {
@@ -807,32 +2178,52 @@ static int parse_arg(int argc, char *argv[])
 	}
 
 	/* sanity check */
-	if ((app.mode == APP_MODE_DELETE) && (app.cmd_cnt == 0))
+	if (check_mode() < 0)
 		return -1;
-	if (app.dont_save) {
-		if (app.mode != APP_MODE_RECEIVE) {
-			app_error("unrecognized -ns\n");
+	if ((app.mode == APP_MODE_DAEMON) && (app.cmd_cnt > 0))
+		return -1;
+	if (app.mode == APP_MODE_UPLOAD) {
+		if (app.cmd_cnt == 0)
 			return -1;
-		}
-		if (app.cmd_cnt != 0) {
-			app_error("commmand specified with -ns\n");
+		if (!app.dev.is_arduino) {
+			app_error("-upload needs -arduino\n");
 			return -1;
 		}
 	}
-	if (app.mode == APP_MODE_FORGE) {
-		if (app.cmd_cnt == 0) {
-			app.mode = APP_MODE_FORGE_TRANSMIT;
-		} else if (app.cmd_cnt > 1) {
-			app_error("too many commmands specified"
-				  " with -forge.\n");
-			return -1;
-		}
+	if ((app.baud != SERIAL_BAUD_DEFAULT) && !app.dev.is_arduino) {
+		app_error("-baud needs -arduino\n");
+		return -1;
 	}
-	if ((app.ch < 1) || (app.ch > 4)) {
-		app_error("bad channel (%d)\n", app.ch);
+	if (app.no_reset && !app.dev.is_arduino) {
+		app_error("-noreset needs -arduino\n");
+		return -1;
+	}
+	if ((app.burst_gap >= 0) && !app.dev.is_arduino) {
+		app_error("-burst needs -arduino\n");
+		return -1;
+	}
+	if (app.dev.use_rle && !app.dev.is_arduino) {
+		app_error("-rle needs -arduino\n");
+		return -1;
+	}
+	if (app.use_edge && !app.dev.is_arduino) {
+		app_error("-edge needs -arduino\n");
+		return -1;
+	}
+	if ((app.dev.idle_ms >= 0) && !app.dev.is_arduino) {
+		app_error("-idle needs -arduino\n");
+		return -1;
+	}
+	if ((app.dev.idle_ms != -1) &&
+	    ((app.dev.idle_ms < 1) || (app.dev.idle_ms > 0xff))) {
+		app_error("bad idle time (%d)\n", app.dev.idle_ms);
+		return -1;
+	}
+	if (app.use_pipeline && !app.dev.is_arduino) {
+		app_error("-pipeline needs -arduino\n");
 		return -1;
 	}
-	if ((!app.is_arduino) && (app.data_len != PCOPRS1_DATA_LEN)) {
+	if ((!app.dev.is_arduino) && (app.data_len != PCOPRS1_DATA_LEN)) {
 		app_error("bad data length (%d)\n", app.data_len);
 		return -1;
 	}
@@ -840,7 +2231,7 @@ static int parse_arg(int argc, char *argv[])
 	/* defaults */
 	if (app.devname == NULL) {
 		app.devname =
-			app.is_arduino ? ARDUINO_TTY_DEV : DEFAULT_TTY_DEV;
+			app.dev.is_arduino ? ARDUINO_TTY_DEV : DEFAULT_TTY_DEV;
 	}
 	if (app.data_dir == NULL) {
 		char *home_dir = getenv("HOME");
@@ -865,13 +2256,33 @@ static int parse_arg(int argc, char *argv[])
 	}
 	sprintf(app.data_fn, "%s/%s", app.data_dir, DATA_FN);
 
+	app.fcache_fn = malloc(strlen(app.data_dir) + sizeof(FCACHE_FN) + 2);
+	if (app.fcache_fn == NULL) {
+		app_error("%s(): memory allocation failed.\n", __func__);
+		return -1;
+	}
+	sprintf(app.fcache_fn, "%s/%s", app.data_dir, FCACHE_FN);
+
+	app.dlib_fn = malloc(strlen(app.data_dir) + sizeof(DLIB_FN) + 2);
+	if (app.dlib_fn == NULL) {
+		app_error("%s(): memory allocation failed.\n", __func__);
+		return -1;
+	}
+	sprintf(app.dlib_fn, "%s/%s", app.data_dir, DLIB_FN);
+
+	app.gap_fn = malloc(strlen(app.data_dir) + sizeof(GAP_FN) + 2);
+	if (app.gap_fn == NULL) {
+		app_error("%s(): memory allocation failed.\n", __func__);
+		return -1;
+	}
+	sprintf(app.gap_fn, "%s/%s", app.data_dir, GAP_FN);
+
 	return 0;
 }
 
 int main(int argc, char **argv)
 {
-	int fd;
-	struct termios tio_old;
+	struct lcdev *dev = &app.dev;
 	int r;
 
 	r = parse_arg(argc, argv);
@@ -884,54 +2295,78 @@ int main(int argc, char **argv)
 	}
 
 	/* device file setup */
-	if (app.is_virtual ||
+	if (dev->is_virtual ||
 	    (app.mode == APP_MODE_LIST) ||
 	    (app.mode == APP_MODE_DELETE) ||
-	    (app.mode == APP_MODE_FORGE))
-		fd = 0;
+	    (app.mode == APP_MODE_FORGE) ||
+	    (app.mode == APP_MODE_FORGE_BULK) ||
+	    ((app.mode == APP_MODE_MATCH) && (app.cmd_cnt > 0)))
+		;	/* dev->fd stays 0 */
 	else if (app.proxy_host) {
-		if ((fd = proxy_open(app.proxy_host, PORT_STR)) < 0)
+		if (lcdev_open_proxy(dev, app.proxy_host, PORT_STR) < 0)
 			return 1;
 	} else {
-		if ((fd = serial_open(app.devname, &tio_old)) < 0)
+		if (lcdev_open(dev, app.devname, app.no_reset) < 0)
 			return 1;
 	}
 
+	if (dev->fd || (app.mode == APP_MODE_DAEMON))
+		setup_signal();
+
 	/* data */
 	lcdata_load(&app.data, app.data_fn);
-	if ((app.mode != APP_MODE_RECEIVE) && (app.data.img_size == 0)) {
+	if ((app.mode != APP_MODE_RECEIVE) &&
+	    (app.mode != APP_MODE_FORGE_BULK) &&
+	    (app.mode != APP_MODE_DAEMON) && (app.data.img_size == 0)) {
 		app_error("data file not found: %s\n", app.data_fn);
+		r = -1;
 		goto out;
 	}
+	if (dev->is_arduino &&
+	    ((app.mode == APP_MODE_TRANSMIT) || (app.mode == APP_MODE_DAEMON)))
+		lcdlib_load(&app.dlib, app.dlib_fn);
+	if ((app.mode == APP_MODE_TRANSMIT) || (app.mode == APP_MODE_DAEMON))
+		gap_load(app.gap_fn);
 
 	/* main */
+	r = 0;
 	switch (app.mode) {
 	case APP_MODE_TRANSMIT:
-		transmit_main(fd);
+		r = transmit_main(dev);
 		break;
 	case APP_MODE_RECEIVE:
-		receive_main(fd);
+		r = receive_main(dev);
 		break;
 	case APP_MODE_LIST:
 		list_main();
 		break;
 	case APP_MODE_DELETE:
-		delete_main();
+		r = delete_main();
 		break;
 	case APP_MODE_FORGE:
 	case APP_MODE_FORGE_TRANSMIT:
-		forge_main(fd);
+		r = forge_main(dev);
+		break;
+	case APP_MODE_MATCH:
+		r = match_main(dev);
+		break;
+	case APP_MODE_FORGE_BULK:
+		r = forge_bulk_main();
+		break;
+	case APP_MODE_UPLOAD:
+		r = upload_main(dev);
+		break;
+	case APP_MODE_DAEMON:
+		r = daemon_main(dev);
 		break;
 	}
 
+	if (app.show_stats)
+		remocon_format_print_stats(stdout);
+
 out:
-	if (fd) {
-		if (app.proxy_host)
-			proxy_close(fd);
-		else
-			serial_close(fd, &tio_old);
-	}
+	lcdev_close(dev);
 	lcdata_free(&app.data);
 
-	return 0;
+	return (r < 0) ? 1 : 0;
 }
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "lemon_corn_async.h"
+
+#include "debug.h"
+
+#define STATE_IDLE		0
+#define STATE_BUSY		1	/* servicing a request */
+#define STATE_CANCELING		2	/* lcasync_cancel() in progress */
+#define STATE_CANCELED		3
+
+/*
+ * intrusive MPSC queue (D. Vyukov)
+ *
+ *   producers swap @head and then link the previous one to theirs.  the
+ *   consumer sees nothing beyond a link not made yet, and picks it up on
+ *   the wakeup which the producer posts after linking.
+ */
+static void queue_push(struct lcasync *as, struct lcasync_req *req)
+{
+	struct lcasync_req *prev;
+
+	__atomic_store_n(&req->next, NULL, __ATOMIC_RELAXED);
+	prev = __atomic_exchange_n(&as->head, req, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&prev->next, req, __ATOMIC_RELEASE);
+}
+
+static struct lcasync_req *queue_pop(struct lcasync *as)
+{
+	struct lcasync_req *tail = as->tail;
+	struct lcasync_req *next = __atomic_load_n(&tail->next,
+						   __ATOMIC_ACQUIRE);
+
+	if (tail == &as->stub) {
+		if (next == NULL)
+			return NULL;
+		as->tail = tail = next;
+		next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	}
+	if (next) {
+		as->tail = next;
+		return tail;
+	}
+	if (tail != __atomic_load_n(&as->head, __ATOMIC_ACQUIRE))
+		return NULL;	/* being linked */
+
+	/* @tail is the last one. put the stub behind to take it out */
+	queue_push(as, &as->stub);
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next) {
+		as->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+static void post(int fd)
+{
+	uint64_t v = 1;
+
+	if (write(fd, &v, sizeof(v)) < 0)
+		app_error("eventfd write error: %s\n", strerror(errno));
+}
+
+/*
+ * the request is over.  no cancel gets to the device after this
+ */
+static void service_end(struct lcasync *as)
+{
+	int st;
+
+	do {
+		st = __atomic_load_n(&as->state, __ATOMIC_ACQUIRE);
+	} while ((st == STATE_CANCELING) ||
+		 !__atomic_compare_exchange_n(&as->state, &st, STATE_IDLE, 0,
+					      __ATOMIC_ACQ_REL,
+					      __ATOMIC_ACQUIRE));
+}
+
+static void service(struct lcasync *as, struct lcasync_req *req)
+{
+	void (*done)(struct lcasync_req *req) = req->done;
+
+	__atomic_store_n(&as->state, STATE_BUSY, __ATOMIC_RELEASE);
+	switch (req->op) {
+	case LCASYNC_OP_TRANSMIT:
+		req->result = lcdev_transmit(as->dev, req->ch,
+					     req->data, req->sz);
+		break;
+	case LCASYNC_OP_TRANSMIT_IDX:
+		req->result = lcdev_transmit_idx(as->dev, req->ch,
+						 req->idx, req->sz);
+		break;
+	case LCASYNC_OP_RECEIVE:
+		req->result = lcdev_receive(as->dev, req->data, req->sz);
+		break;
+	case LCASYNC_OP_RECEIVE_EDGE:
+		req->result = lcdev_receive_edge_bitmap(as->dev, req->data,
+							req->sz);
+		break;
+	default:
+		app_error("unknown request (%d)\n", req->op);
+		req->result = -1;
+		break;
+	}
+	/* a cancel is for the request in progress only */
+	service_end(as);
+	if (lcdev_is_canceled(as->dev))
+		lcdev_resync(as->dev);
+
+	/* @req may be freed or reused from here */
+	__atomic_store_n(&req->is_done, 1, __ATOMIC_RELEASE);
+	if (done)
+		done(req);
+	post(as->done_fd);
+}
+
+static void *io_thread(void *arg)
+{
+	struct lcasync *as = arg;
+	struct lcasync_req *req;
+	uint64_t v;
+
+	while (1) {
+		while ((req = queue_pop(as))) {
+			if (req == &as->stop)
+				return NULL;
+			service(as, req);
+		}
+		if ((read(as->wake_fd, &v, sizeof(v)) < 0) &&
+		    (errno != EINTR)) {
+			app_error("eventfd read error: %s\n", strerror(errno));
+			return NULL;
+		}
+	}
+}
+
+/*
+ * @dev is used only by the I/O thread until lcasync_stop()
+ */
+int lcasync_start(struct lcasync *as, struct lcdev *dev)
+{
+	sigset_t all, old;
+
+	memset(as, 0, sizeof(*as));
+	as->dev = dev;
+	as->head = as->tail = &as->stub;
+	as->stop.op = LCASYNC_OP_STOP;
+
+	if ((as->wake_fd = eventfd(0, EFD_CLOEXEC)) < 0)
+		goto err;
+	if ((as->done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+		close(as->wake_fd);
+		goto err;
+	}
+	/* the signals go to the caller's threads. see lcasync_cancel() */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	errno = pthread_create(&as->thread, NULL, io_thread, as);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (errno) {
+		close(as->wake_fd);
+		close(as->done_fd);
+		goto err;
+	}
+	return 0;
+
+err:
+	app_error("%s(): %s\n", __func__, strerror(errno));
+	return -1;
+}
+
+/*
+ * the requests queued so far are serviced before the I/O thread exits
+ */
+void lcasync_stop(struct lcasync *as)
+{
+	lcasync_submit(as, &as->stop);
+	pthread_join(as->thread, NULL);
+	close(as->wake_fd);
+	close(as->done_fd);
+}
+
+void lcasync_submit(struct lcasync *as, struct lcasync_req *req)
+{
+	__atomic_store_n(&req->is_done, 0, __ATOMIC_RELAXED);
+	queue_push(as, req);
+	post(as->wake_fd);
+}
+
+/*
+ * abort the request in progress.  the queued ones are still serviced,
+ * and nothing is canceled if the I/O thread is idle.
+ * safe in a signal handler (see lcdev_cancel())
+ */
+void lcasync_cancel(struct lcasync *as)
+{
+	int st = STATE_BUSY;
+
+	if (!__atomic_compare_exchange_n(&as->state, &st, STATE_CANCELING, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		return;
+	lcdev_cancel(as->dev);
+	__atomic_store_n(&as->state, STATE_CANCELED, __ATOMIC_RELEASE);
+}
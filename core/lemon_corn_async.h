@@ -0,0 +1,64 @@
+#ifndef _LEMON_CORN_ASYNC_H
+#define _LEMON_CORN_ASYNC_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include "lemon_corn_dev.h"
+
+/*
+ * asynchronous requests to a device
+ *
+ *   the requests are queued by any number of threads without a lock, and
+ *   serviced in order by the I/O thread of the device, which owns the
+ *   device handle while it runs, and takes no signals.  the request is
+ *   the caller's, and must be kept until it completes.
+ *
+ *   on the completion, @result is what the lcdev_*() returned, and
+ *   lcasync_req_is_done() tells it is ready.  then @done is called on
+ *   the I/O thread if given, and @done_fd (eventfd) is signaled.  the
+ *   request is back to the caller once @done is called, which may free
+ *   or submit it again.  without @done, it is back once it is done.
+ */
+#define LCASYNC_OP_TRANSMIT	0	/* @data, @sz on @ch */
+#define LCASYNC_OP_TRANSMIT_IDX	1	/* @idx on @ch. @sz of signal */
+#define LCASYNC_OP_RECEIVE	2	/* into @data, @sz */
+#define LCASYNC_OP_RECEIVE_EDGE	3	/* same as above, from the edges */
+#define LCASYNC_OP_STOP		4	/* internal */
+
+struct lcasync_req {
+	int op;
+	int ch;
+	int idx;
+	unsigned char *data;
+	size_t sz;
+	void (*done)(struct lcasync_req *req);
+	void *priv;
+	int result;
+	int is_done;
+	struct lcasync_req *next;	/* queue */
+};
+
+struct lcasync {
+	struct lcdev *dev;
+	pthread_t thread;
+	int wake_fd;		/* eventfd. the queue is not empty */
+	int done_fd;		/* eventfd. requests completed */
+	/* MPSC queue. pushed at @head, popped at @tail */
+	struct lcasync_req *head;
+	struct lcasync_req *tail;
+	struct lcasync_req stub;
+	struct lcasync_req stop;
+	int state;		/* of the I/O thread. see lcasync_cancel() */
+};
+
+extern int lcasync_start(struct lcasync *as, struct lcdev *dev);
+extern void lcasync_stop(struct lcasync *as);
+extern void lcasync_submit(struct lcasync *as, struct lcasync_req *req);
+extern void lcasync_cancel(struct lcasync *as);
+
+static inline int lcasync_req_is_done(const struct lcasync_req *req)
+{
+	return __atomic_load_n(&req->is_done, __ATOMIC_ACQUIRE);
+}
+
+#endif	/* _LEMON_CORN_ASYNC_H */
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <libgen.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "lemon_corn_ctl.h"
+
+#include "debug.h"
+
+static struct app {
+	const char *sock_path;
+	char req[LCCTL_REQ_LEN_MAX];
+} app;
+
+static void usage(const char *cmd_path)
+{
+	char *cpy_path = strdup(cmd_path);
+
+	fprintf(stderr,
+"usage: %s\n"
+"        [-S <socket>]        (default is " LCCTL_SOCK_DEFAULT ")\n"
+LCCTL_USAGE
+"        [-h]                 (help)\n",
+		basename(cpy_path));
+	free(cpy_path);
+}
+
+/*
+ * parse command line options
+ * the rest of the arguments are passed to the daemon as they are.
+ * return value:
+ *   0: success
+ *  -1: error
+ *   1: show usage and exit
+ */
+static int parse_arg(int argc, char *argv[])
+{
+	size_t len = 0;
+	int i;
+
+	/* init */
+	app.sock_path = LCCTL_SOCK_DEFAULT;
+	app.req[0] = '\0';
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-S")) {
+			if (++i == argc)
+				return -1;
+			app.sock_path = argv[i];
+		} else if (!strcmp(argv[i], "-h")) {
+			return 1;
+		} else {
+			size_t arg_len = strlen(argv[i]);
+
+			/* with a space and '\n' */
+			if (len + arg_len + 2 > sizeof(app.req)) {
+				app_error("too long request\n");
+				return -1;
+			}
+			if (len)
+				app.req[len++] = ' ';
+			memcpy(app.req + len, argv[i], arg_len);
+			len += arg_len;
+		}
+	}
+
+	/* sanity check */
+	if (len == 0)
+		return 1;
+	app.req[len++] = '\n';
+	app.req[len] = '\0';
+
+	return 0;
+}
+
+static int ctl_open(const char *path)
+{
+	struct sockaddr_un sa;
+	int fd;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		app_error("socket() failed\n");
+		return -1;
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	strncpy(sa.sun_path, path, sizeof(sa.sun_path) - 1);
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+		app_error("connect failed: %s (%s)\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int main(int argc, char **argv)
+{
+	char buf[256];
+	int status = -1;
+	int got_end = 0;
+	int fd;
+	int r;
+
+	r = parse_arg(argc, argv);
+	if (r < 0) {
+		usage(argv[0]);
+		return 1;
+	} else if (r == 1) {
+		usage(argv[0]);
+		return 0;
+	}
+
+	if ((fd = ctl_open(app.sock_path)) < 0)
+		return 1;
+	if (write(fd, app.req, strlen(app.req)) < 0) {
+		app_error("write error: %s\n", strerror(errno));
+		close(fd);
+		return 1;
+	}
+
+	/* the output, then '\0' and the status */
+	while ((r = read(fd, buf, sizeof(buf))) > 0) {
+		char *endp;
+
+		if (got_end) {
+			status = (unsigned char)buf[0];
+			break;
+		}
+		endp = memchr(buf, '\0', r);
+		fwrite(buf, 1, endp ? endp - buf : r, stdout);
+		if (endp) {
+			got_end = 1;
+			if (endp + 1 < buf + r) {
+				status = (unsigned char)endp[1];
+				break;
+			}
+		}
+	}
+	close(fd);
+
+	if (status < 0) {
+		app_error("connection closed by the daemon\n");
+		return 1;
+	}
+	return status;
+}
@@ -0,0 +1,41 @@
+#ifndef _LEMON_CORN_CTL_H
+#define _LEMON_CORN_CTL_H
+
+/*
+ * control socket of the lemon_corn daemon  (lemon_corn -daemon)
+ *
+ *   the daemon keeps the device open and the data loaded, and handles
+ *   one request per connection on a unix domain stream socket.  the
+ *   requests are served one at a time; the others wait in the backlog.
+ *
+ *   client -> daemon:
+ *     a request line: lemon_corn options and commands separated by
+ *     spaces, ended by '\n' within LCCTL_REQ_TIMEOUT_MS of the
+ *     connection.  only the options selecting what to do are
+ *     accepted (see LCCTL_USAGE).  the device options are the daemon's.
+ *   daemon -> client:
+ *     the output of the request as it is produced, then '\0' and
+ *     the status (LCCTL_STATUS_*).  then the daemon closes the
+ *     connection.
+ *
+ *   the socket is accessible to the owner of the daemon only.
+ */
+#define LCCTL_SOCK_DEFAULT	"/tmp/lemon_corn.sock"
+#define LCCTL_REQ_LEN_MAX	1024
+#define LCCTL_REQ_TIMEOUT_MS	2000	/* for the whole request line */
+
+#define LCCTL_STATUS_OK		0
+#define LCCTL_STATUS_BAD_REQ	1
+#define LCCTL_STATUS_FAILED	2	/* the request is done, but failed */
+
+#define LCCTL_USAGE \
+"        [-r [<command(s)>]]  (receive)\n" \
+"        [-cl | -l | -p | -f] (list)\n" \
+"        [-d <command(s)>]    (delete)\n" \
+"        [-match [<command(s)>]] [-k <num>]  (find similar commands)\n" \
+"        [-forge <format> [<command>]]  (forge command with known format)\n" \
+"        [-ns]                (do not save with -r)\n" \
+"        [-ch <channel>]\n" \
+"        [command(s)]         (send)\n"
+
+#endif	/* _LEMON_CORN_CTL_H */
@@ -31,57 +31,259 @@
 
 #include "debug.h"
 
+static void index_free(struct lcdata *lcdata)
+{
+	if (lcdata->idx == NULL)
+		return;
+	free(lcdata->idx->head);
+	free(lcdata->idx->ents);
+	free(lcdata->idx);
+	lcdata->idx = NULL;
+}
+
 void lcdata_free(struct lcdata *lcdata)
 {
+	index_free(lcdata);
 	free(lcdata->ent_img);
+	lcdata->ent_img = NULL;
+	lcdata->img_size = 0;
 }
 
+#define get_be16(ary)	(((unsigned short)(ary)[0] << 8) | \
+			 (unsigned short)(ary)[1])
+
 void *lcdata_parse_ent(void *p, struct lcdata_ent *ent)
 {
 	struct lcdata_ent_img_var *vent = p;
 
-	if (vent->dummy == 0) {	/* it's me. */
+	ent->rep_count = 0;
+	if ((vent->dummy == 0) && (vent->type == LCDATA_ENT_TYPE_REP)) {
+		struct lcdata_ent_img_rep *rent = p;
+		ent->tag = rent->tag;
+		ent->data = rent->data;
+		ent->data_size = get_be16(rent->total);
+		ent->img_data_size = get_be16(rent->len);
+		ent->rep_start = get_be16(rent->start);
+		ent->rep_period = get_be16(rent->period);
+		ent->rep_count = rent->count;
+		return ent->data + ent->img_data_size;
+	} else if (vent->dummy == 0) {	/* it's me. */
 		ent->tag = vent->tag;
 		ent->data = vent->data;
-		ent->data_size = ((unsigned short)vent->len[0] << 8) |
-				  (unsigned short)vent->len[1];
+		ent->data_size = get_be16(vent->len);
 	} else {		/* nope. fixed size. */
 		struct lcdata_ent_img_fxd *fent = p;
 		ent->tag = fent->tag;
 		ent->data = fent->data;
 		ent->data_size = PCOPRS1_DATA_LEN;
 	}
+	ent->img_data_size = ent->data_size;
 	return ent->data + ent->data_size;
 }
 
-int lcdata_get_cmd_by_tag(struct lcdata *lcdata, const char *tag,
-			  struct lcdata_ent *ent)
+/*
+ * invalidated entries are parsed as variable size ones,
+ * so @len covers the whole entry.
+ */
+void lcdata_ent_img_invalidate(void *p)
 {
-	void *p, *nextp, *endp;
+	struct lcdata_ent_img_var *vent = p;
+	struct lcdata_ent ent;
+	size_t len;
 
-	lcdata_for_each_entry(lcdata, ent, p, nextp, endp) {
-		if (!strcmp(tag, ent->tag))
-			return 0;
+	len = (unsigned char *)lcdata_parse_ent(p, &ent) -
+		(unsigned char *)vent->data;
+	lcdata_ent_img_var_initialize(vent, len);
+	vent->type = 0;
+}
+
+/*
+ * copy @n samples (bits) from @src at @src_idx to @dst at @dst_idx
+ * the samples out of @src_total are regarded as 0.  @dst must be cleared.
+ */
+static void copy_bits(unsigned char *dst, int dst_idx,
+		      const unsigned char *src, int src_idx, int src_total,
+		      int n)
+{
+	int i;
+
+	if (src_idx + n > src_total)
+		n = src_total - src_idx;
+	for (i = 0; i < n; i++) {
+		if (src[(src_idx + i) / 8] & (1 << ((src_idx + i) % 8)))
+			dst[(dst_idx + i) / 8] |= 1 << ((dst_idx + i) % 8);
 	}
+}
 
-	/* not found */
-	return -1;
+/*
+ * expand the entry data to @dst (@ent->data_size bytes)
+ */
+void lcdata_ent_expand(const struct lcdata_ent *ent, unsigned char *dst)
+{
+	int total = ent->data_size * 8;
+	int img_total = ent->img_data_size * 8;
+	int head, pos;
+	int i;
+
+	if (ent->rep_count == 0) {
+		memcpy(dst, ent->data, ent->data_size);
+		return;
+	}
+
+	memset(dst, 0, ent->data_size);
+	head = ent->rep_start + ent->rep_period;
+	if (head > total)
+		head = total;
+	copy_bits(dst, 0, ent->data, 0, img_total, head);
+
+	for (i = 1, pos = head; (i < ent->rep_count) && (pos < total);
+	     i++, pos += ent->rep_period) {
+		copy_bits(dst, pos, ent->data, ent->rep_start, img_total,
+			  (pos + ent->rep_period > total) ?
+				total - pos : ent->rep_period);
+	}
+
+	/* the rest after the last cycle */
+	if (pos < total)
+		copy_bits(dst, pos, ent->data, head, img_total, total - pos);
 }
 
-int lcdata_delete_by_tag(struct lcdata *lcdata, const char *tag)
+/*
+ * store @count cycles of @period samples from @start just once
+ * returns the length stored in @dst (@sz bytes at least)
+ */
+size_t lcdata_rep_factor(unsigned char *dst, const unsigned char *src,
+			 size_t sz, int start, int period, int count)
+{
+	int total = sz * 8;
+	int head = start + period;
+	int tail = start + count * period;
+	int len;
+
+	memset(dst, 0, sz);
+	if (head > total)
+		head = total;
+	if (tail > total)
+		tail = total;
+	copy_bits(dst, 0, src, 0, total, head);
+	copy_bits(dst, head, src, tail, total, total - tail);
+
+	/* trailing 0s are restored on expansion */
+	for (len = (head + total - tail + 7) / 8; len > 0; len--) {
+		if (dst[len - 1])
+			break;
+	}
+	return len;
+}
+
+/* FNV-1a */
+static unsigned int tag_hash(const char *tag)
 {
+	unsigned int h = 2166136261u;
+
+	for (; *tag; tag++)
+		h = (h ^ (unsigned char)*tag) * 16777619u;
+	return h;
+}
+
+/*
+ * index the entries by the tag, so that the lookups don't walk the
+ * whole image.  done again after the image is reloaded.
+ */
+int lcdata_index(struct lcdata *lcdata)
+{
+	struct lcdata_idx *idx;
 	struct lcdata_ent ent;
 	void *p, *nextp, *endp;
+	unsigned int i;
+	int n_ents = 0;
+
+	index_free(lcdata);
+	lcdata_for_each_entry(lcdata, &ent, p, nextp, endp)
+		n_ents++;
 
+	if ((idx = calloc(1, sizeof(*idx))) == NULL)
+		return -1;
+	for (idx->n_buckets = 16; idx->n_buckets < n_ents * 2U;
+	     idx->n_buckets *= 2)
+		;
+	idx->head = malloc(sizeof(int) * idx->n_buckets);
+	idx->ents = malloc(sizeof(struct lcdata_idx_ent) * (n_ents + 1));
+	if ((idx->head == NULL) || (idx->ents == NULL)) {
+		app_error("%s(): memory allocation failed.\n", __func__);
+		free(idx->head);
+		free(idx->ents);
+		free(idx);
+		return -1;
+	}
+	for (i = 0; i < idx->n_buckets; i++)
+		idx->head[i] = -1;
+
+	n_ents = 0;
 	lcdata_for_each_entry(lcdata, &ent, p, nextp, endp) {
-		if (!strcmp(tag, ent.tag)) {
-			lcdata_ent_img_invalidate(p);
-			return 0;
+		int *link;
+
+		if (!lcdata_ent_img_is_valid(p))
+			continue;
+		link = &idx->head[tag_hash(ent.tag) & (idx->n_buckets - 1)];
+		while (*link >= 0)
+			link = &idx->ents[*link].next;
+		idx->ents[n_ents].ofs = p - lcdata->ent_img;
+		idx->ents[n_ents].next = -1;
+		*link = n_ents++;
+	}
+
+	lcdata->idx = idx;
+	return 0;
+}
+
+/*
+ * the first valid entry with @tag, or NULL
+ */
+static void *lookup(struct lcdata *lcdata, const char *tag,
+		    struct lcdata_ent *ent)
+{
+	const struct lcdata_idx *idx = lcdata->idx;
+	void *p, *nextp, *endp;
+	int i;
+
+	if (idx == NULL) {
+		lcdata_for_each_entry(lcdata, ent, p, nextp, endp) {
+			if (!lcdata_ent_img_is_valid(p))
+				continue;
+			if (!strcmp(tag, ent->tag))
+				return p;
 		}
+		return NULL;
 	}
 
-	/* not found */
-	return -1;
+	for (i = idx->head[tag_hash(tag) & (idx->n_buckets - 1)]; i >= 0;
+	     i = idx->ents[i].next) {
+		p = lcdata->ent_img + idx->ents[i].ofs;
+		if (!lcdata_ent_img_is_valid(p))
+			continue;
+		lcdata_parse_ent(p, ent);
+		if (!strcmp(tag, ent->tag))
+			return p;
+	}
+	return NULL;
+}
+
+int lcdata_get_cmd_by_tag(struct lcdata *lcdata, const char *tag,
+			  struct lcdata_ent *ent)
+{
+	return lookup(lcdata, tag, ent) ? 0 : -1;
+}
+
+int lcdata_delete_by_tag(struct lcdata *lcdata, const char *tag)
+{
+	struct lcdata_ent ent;
+	void *p;
+
+	if ((p = lookup(lcdata, tag, &ent)) == NULL)
+		return -1;
+	lcdata_ent_img_invalidate(p);
+	return 0;
 }
 
 int lcdata_load(struct lcdata *lcdata, const char *fn)
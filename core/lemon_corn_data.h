@@ -1,6 +1,7 @@
 #ifndef _LEMON_CORN_DATA_H
 #define _LEMON_CORN_DATA_H
 
+#include <stddef.h>
 #include "PC-OP-RS1.h"
 
 #define LEMON_CORN_TAG_LEN	32
@@ -19,7 +20,20 @@
  *     tag:   command tag string
  *     data:  size is @len
  *
- *   when invalidating the entry, set 0 to first 2 bytes.
+ *   [repeated]
+ *     dummy:  0
+ *     type:   2
+ *     len:    the length of the data (big endian)
+ *     tag:    command tag string
+ *     total:  the length of the data after expansion (big endian)
+ *     start:  sample where the first cycle starts (big endian)
+ *     period: cycle period in samples (big endian)
+ *     count:  number of the cycles
+ *     data:   size is @len. samples up to the end of the first cycle,
+ *             followed by the samples after the last cycle
+ *
+ *   when invalidating the entry, set 0 to first 2 bytes, and @len to
+ *   the size of the rest.  (see lcdata_ent_img_invalidate())
  *
  */
 struct lcdata_ent_img_fxd {
@@ -34,11 +48,21 @@ struct lcdata_ent_img_var {
 	unsigned char data[0];
 };
 
-#define lcdata_ent_img_invalidate(ent_img) \
-	do { \
-		((struct lcdata_ent_img_var *)ent_img)->dummy = 0; \
-		((struct lcdata_ent_img_var *)ent_img)->type = 0; \
-	} while (0)
+struct lcdata_ent_img_rep {
+	unsigned char dummy;
+	unsigned char type;
+	unsigned char len[2];
+	char tag[LEMON_CORN_TAG_LEN];
+	unsigned char total[2];
+	unsigned char start[2];
+	unsigned char period[2];
+	unsigned char count;
+	unsigned char data[0];
+};
+
+#define LCDATA_ENT_TYPE_VAR	1
+#define LCDATA_ENT_TYPE_REP	2
+
 
 #define lcdata_ent_img_is_valid(ent_img) \
 	((((struct lcdata_ent_img_var *)ent_img)->dummy != 0) || \
@@ -47,20 +71,66 @@ struct lcdata_ent_img_var {
 #define lcdata_ent_img_var_initialize(ventp, __len) \
 	do { \
 		(ventp)->dummy = 0; \
-		(ventp)->type = 1; \
+		(ventp)->type = LCDATA_ENT_TYPE_VAR; \
 		(ventp)->len[0] = (unsigned char)((__len) >> 8); \
 		(ventp)->len[1] = (unsigned char)((__len) & 0xff); \
 	} while (0)
 
+#define lcdata_ent_img_rep_initialize(rentp, __len, __total, \
+				      __start, __period, __count) \
+	do { \
+		(rentp)->dummy = 0; \
+		(rentp)->type = LCDATA_ENT_TYPE_REP; \
+		(rentp)->len[0] = (unsigned char)((__len) >> 8); \
+		(rentp)->len[1] = (unsigned char)((__len) & 0xff); \
+		(rentp)->total[0] = (unsigned char)((__total) >> 8); \
+		(rentp)->total[1] = (unsigned char)((__total) & 0xff); \
+		(rentp)->start[0] = (unsigned char)((__start) >> 8); \
+		(rentp)->start[1] = (unsigned char)((__start) & 0xff); \
+		(rentp)->period[0] = (unsigned char)((__period) >> 8); \
+		(rentp)->period[1] = (unsigned char)((__period) & 0xff); \
+		(rentp)->count = (__count); \
+	} while (0)
+
+/*
+ * @data_size is the size after expansion.
+ * use lcdata_ent_expand() to get the data of repeated entries.
+ */
 struct lcdata_ent {
 	char *tag;
 	unsigned char *data;
 	unsigned short data_size;
+
+	/* repeated entry only (rep_count > 0) */
+	unsigned short img_data_size;
+	unsigned short rep_start, rep_period;
+	unsigned char rep_count;
+};
+
+/*
+ * tag index of the image (see lcdata_index())
+ *   the entries of a bucket are chained from @head in the image order.
+ *   an entry is kept after it is invalidated, and skipped on lookup.
+ */
+struct lcdata_idx_ent {
+	int ofs;		/* in the image */
+	int next;		/* -1 at the end of the chain */
 };
 
+struct lcdata_idx {
+	unsigned int n_buckets;	/* power of 2 */
+	int *head;
+	struct lcdata_idx_ent *ents;
+};
+
+/*
+ * @idx is NULL until lcdata_index().  the image must not be changed
+ * except by lcdata_delete_by_tag() while it is indexed.
+ */
 struct lcdata {
 	int img_size;
 	void *ent_img;
+	struct lcdata_idx *idx;
 };
 
 #define lcdata_for_each_entry(lcdata, entp, p, nextp, endp) \
@@ -74,12 +144,21 @@ extern void
 lcdata_free(struct lcdata *lcdata);
 extern void
 *lcdata_parse_ent(void *p, struct lcdata_ent *ent);
+extern void
+lcdata_ent_img_invalidate(void *p);
+extern void
+lcdata_ent_expand(const struct lcdata_ent *ent, unsigned char *dst);
+extern size_t
+lcdata_rep_factor(unsigned char *dst, const unsigned char *src, size_t sz,
+		  int start, int period, int count);
 extern int
 lcdata_get_cmd_by_tag(struct lcdata *lcdata, const char *tag,
 		      struct lcdata_ent *ent);
 extern int
 lcdata_delete_by_tag(struct lcdata *lcdata, const char *tag);
 extern int
+lcdata_index(struct lcdata *lcdata);
+extern int
 lcdata_load(struct lcdata *lcdata, const char *fn);
 extern int
 __lcdata_save(const struct lcdata *lcdata, const char *fn, int is_append);
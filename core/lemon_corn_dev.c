@@ -0,0 +1,866 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include "lemon_corn_dev.h"
+#include "lemon_corn_rle.h"
+#include "serial_util.h"
+#include "string_util.h"
+#include "PC-OP-RS1.h"
+#include "lemon_squash.h"
+
+#define DEBUG_HEAD_LEMON_CORN_DEV	"[lemon_corn_dev] "
+#ifndef DEBUG_LEVEL_LEMON_CORN_DEV
+#define DEBUG_LEVEL_LEMON_CORN_DEV	0
+#endif
+#include "debug.h"
+
+#define IO_TIMEOUT_MS		LCDEV_IO_TIMEOUT_MS
+#define ARDUINO_SETUP_WAIT_MS	3000
+#define RESYNC_DRAIN_MS		50
+#define RESYNC_SKIP_MAX		8192	/* bytes */
+#define TRANSMIT_RETRY_MAX	2
+#define TRANSMIT_ERR_SENT	-2	/* failed after the data is sent */
+#define CANCEL_POLL_MS		100
+
+#if (DEBUG_LEVEL_LEMON_CORN_DEV >= 1)
+static char *hexdump(char *dst, const unsigned char *data, size_t sz)
+{
+	unsigned int i;
+
+	for (i = 0; i < sz; i++)
+		sprintf(&dst[i * 2], "%02x", data[i]);
+	dst[sz * 2] = '\0';
+
+	return dst;
+}
+#endif
+
+static int remocon_send(struct lcdev *dev, const unsigned char *data,
+			size_t sz)
+{
+	const unsigned char *rp;
+	int rest, wcnt;
+
+	if (dev->is_virtual)
+		return sz;
+
+	for (rp = data, rest = sz; rest; rp += wcnt, rest -= wcnt) {
+		wcnt = write(dev->fd, rp, rest);
+		if (wcnt < 0) {
+			app_error("write error: %s\n", strerror(errno));
+			return wcnt;
+		}
+	}
+
+#if (DEBUG_LEVEL_LEMON_CORN_DEV >= 1)
+{
+	char s[sz * 2 + 1];
+	app_debug(LEMON_CORN_DEV, 1, "sent: %s\n", hexdump(s, data, sz));
+}
+#endif
+
+	return sz;
+}
+
+/*
+ * read @sz bytes in @timeout_ms (no limit if negative)
+ * a single byte, which is what the long waits (for the signal, or for
+ * the device to finish) are for, is waited for in slices so that
+ * lcdev_cancel() from another thread is noticed.
+ */
+static int remocon_read_timeout(struct lcdev *dev, unsigned char *data,
+				size_t sz, int timeout_ms)
+{
+	long long rest = timeout_ms;
+	int r;
+
+	if (lcdev_is_canceled(dev))
+		return -1;
+	app_debug(LEMON_CORN_DEV, 1, "waiting for data...\n");
+	if (sz == 1) {
+		do {
+			int slice = ((rest < 0) || (rest > CANCEL_POLL_MS)) ?
+				    CANCEL_POLL_MS : rest;
+
+			r = serial_read_timeout(dev->fd, data, 1, slice);
+			if (rest > 0)
+				rest -= slice;
+		} while ((r == 0) && (rest != 0) && !lcdev_is_canceled(dev));
+	} else {
+		r = serial_read_timeout(dev->fd, data, sz, timeout_ms);
+	}
+	if ((r == 0) && lcdev_is_canceled(dev)) {
+		app_error("canceled\n");
+		return -1;
+	} else if (r == 0) {
+		app_error("timed out waiting for the device\n");
+		return -1;
+	} else if (r < 0) {
+		if (errno == EINTR)
+			app_error("interrupted\n");
+		return -1;
+	}
+
+#if (DEBUG_LEVEL_LEMON_CORN_DEV >= 1)
+{
+	char s[sz * 2 + 1];
+	app_debug(LEMON_CORN_DEV, 1, "read: %s\n", hexdump(s, data, sz));
+}
+#endif
+
+	return sz;
+}
+
+static int remocon_read(struct lcdev *dev, unsigned char *data, size_t sz)
+{
+	return remocon_read_timeout(dev, data, sz, IO_TIMEOUT_MS);
+}
+
+static int remocon_expect_timeout(struct lcdev *dev, unsigned char expect,
+				  int timeout_ms)
+{
+	unsigned char c;
+
+	if (dev->is_virtual)
+		return 0;
+
+	if (remocon_read_timeout(dev, &c, 1, timeout_ms) < 0)
+		return -1;
+	if (c != expect) {
+		app_error("expect '%c'(0x%02x), but got '%c'(0x%02x)\n",
+			  expect, expect, c, c);
+		return -1;
+	}
+	return 0;
+}
+
+static int remocon_expect(struct lcdev *dev, unsigned char expect)
+{
+	return remocon_expect_timeout(dev, expect, IO_TIMEOUT_MS);
+}
+
+/*
+ * returns the index of the received one in @expect_ary
+ */
+static int remocon_expect2_timeout(struct lcdev *dev, unsigned char *expect_ary,
+				   int len, int timeout_ms)
+{
+	unsigned char c;
+	char buf[256] = "";
+	int i;
+
+	if (dev->is_virtual)
+		return 0;
+
+	if (remocon_read_timeout(dev, &c, 1, timeout_ms) < 0)
+		return -1;
+	for (i = 0; i < len; i++)
+		if (c == expect_ary[i])
+			return i;
+
+	for (i = 0; i < len; i++)
+		strcatf(buf, " '%c'(0x%02x)", expect_ary[i], expect_ary[i]);
+	app_error("expect %s\n", buf);
+	app_error("but got '%c'(0x%02x)\n", c, c);
+	return -1;
+}
+
+static int remocon_expect2(struct lcdev *dev, unsigned char *expect_ary,
+			   int len)
+{
+	return remocon_expect2_timeout(dev, expect_ary, len, IO_TIMEOUT_MS);
+}
+
+/*
+ * get back in step with the device after an error or a cancel
+ * the stale bytes are dropped until the device answers PCOPRS1_CMD_LED.
+ */
+int lcdev_resync(struct lcdev *dev)
+{
+	unsigned char c;
+	int n_skip;
+	int found = 0;
+
+	__atomic_store_n(&dev->canceled, 0, __ATOMIC_RELEASE);
+	if (dev->is_virtual)
+		return 0;
+
+	if (!dev->is_proxy)
+		tcflush(dev->fd, TCIFLUSH);
+	c = PCOPRS1_CMD_LED;
+	if (remocon_send(dev, &c, 1) < 0)
+		return -1;
+	for (n_skip = 0; n_skip < RESYNC_SKIP_MAX; n_skip++) {
+		if (serial_read_timeout(dev->fd, &c, 1, found ?
+					RESYNC_DRAIN_MS : IO_TIMEOUT_MS) != 1)
+			break;
+		if ((c == PCOPRS1_CMD_LED_OK) || (c == PCOPRS1_CMD_OK))
+			found = 1;
+	}
+	if (!found) {
+		app_error("lost the device\n");
+		return -1;
+	}
+	app_debug(LEMON_CORN_DEV, 1, "resynchronized\n");
+	return 0;
+}
+
+/*
+ * abort the pending receive
+ */
+static void receive_cancel(struct lcdev *dev)
+{
+	unsigned char c = PCOPRS1_CMD_RECEIVE_CANCEL;
+
+	if (dev->is_virtual)
+		return;
+	remocon_send(dev, &c, 1);
+	lcdev_resync(dev);
+}
+
+/*
+ * wait for the signal for @dev->rcv_timeout_ms
+ */
+static int remocon_wait_signal(struct lcdev *dev)
+{
+	return remocon_expect_timeout(dev, PCOPRS1_CMD_RECEIVE_DATA,
+				      dev->rcv_timeout_ms);
+}
+
+/*
+ * returns 1 if the run-length coded data isn't shorter, and
+ * TRANSMIT_ERR_SENT if it fails after the data is handed to the device
+ */
+static int transmit_rle(struct lcdev *dev, int ch,
+			const unsigned char *data, size_t sz)
+{
+	unsigned char rle[sz];
+	unsigned char buf[2];
+	size_t len;
+
+	if ((lcrle_encode(rle, sz, data, sz, &len) < 0) || (len > 0xffff))
+		return 1;
+	app_debug(LEMON_CORN_DEV, 1, "run-length coded %zu -> %zu bytes\n",
+		  sz, len);
+
+	buf[0] = LEMON_SQUASH_CMD_TRANSMIT_RLE;
+	if (remocon_send(dev, buf, 1) < 0)
+		return -1;
+	if (remocon_expect(dev, PCOPRS1_CMD_OK) < 0)
+		return -1;
+	buf[0] = (unsigned char)(len >> 8);
+	buf[1] = (unsigned char)len;
+	if (remocon_send(dev, buf, 2) < 0)
+		return -1;
+	if (remocon_expect(dev, PCOPRS1_CMD_OK) < 0)
+		return -1;
+	buf[0] = PCOPRS1_CMD_CHANNEL(ch);
+	if (remocon_send(dev, buf, 1) < 0)
+		return -1;
+	if (remocon_expect(dev, PCOPRS1_CMD_OK) < 0)
+		return -1;
+	if (remocon_send(dev, rle, len) < 0)
+		return TRANSMIT_ERR_SENT;
+	if (remocon_expect_timeout(dev, PCOPRS1_CMD_DATA_COMPLETION,
+				   IO_TIMEOUT_MS + lcdev_signal_ms(sz)) < 0)
+		return TRANSMIT_ERR_SENT;
+
+	return 0;
+}
+
+/*
+ * returns TRANSMIT_ERR_SENT if it fails after the data is handed to the
+ * device, which may have emitted the signal then
+ */
+static int transmit_once(struct lcdev *dev, int ch,
+			 const unsigned char *data, size_t sz)
+{
+	unsigned char c;
+	unsigned char pad_buf[PCOPRS1_DATA_LEN];
+	int r;
+
+	if (dev->use_rle && ((r = transmit_rle(dev, ch, data, sz)) <= 0))
+		return r;
+
+	/* trimmed data. PC-OP-RS1 accepts the fixed length only */
+	if (!dev->is_arduino && (sz < PCOPRS1_DATA_LEN)) {
+		memset(pad_buf, 0, sizeof(pad_buf));
+		memcpy(pad_buf, data, sz);
+		data = pad_buf;
+		sz = PCOPRS1_DATA_LEN;
+	}
+
+	if (sz == PCOPRS1_DATA_LEN) {
+		c = PCOPRS1_CMD_TRANSMIT;
+		if (remocon_send(dev, &c, 1) < 0)
+			return -1;
+		if (remocon_expect(dev, PCOPRS1_CMD_OK) < 0)
+			return -1;
+		c = PCOPRS1_CMD_CHANNEL(ch);
+		if (remocon_send(dev, &c, 1) < 0)
+			return -1;
+		if (remocon_expect(dev, PCOPRS1_CMD_OK) < 0)
+			return -1;
+		if (remocon_send(dev, data, sz) < 0)
+			return TRANSMIT_ERR_SENT;
+		if (remocon_expect_timeout(dev, PCOPRS1_CMD_DATA_COMPLETION,
+					   IO_TIMEOUT_MS + lcdev_signal_ms(sz)) < 0)
+			return TRANSMIT_ERR_SENT;
+	} else {
+		if (sz % LEMON_SQUASH_DATA_UNIT_LEN != 0) {
+			app_error("invalid data len %zu\n", sz);
+			return -1;
+		}
+		c = LEMON_SQUASH_CMD_TRANSMIT2;
+		if (remocon_send(dev, &c, 1) < 0)
+			return -1;
+		if (remocon_expect(dev, PCOPRS1_CMD_OK) < 0)
+			return -1;
+		c = sz / LEMON_SQUASH_DATA_UNIT_LEN;
+		if (remocon_send(dev, &c, 1) < 0)
+			return -1;
+		if (remocon_expect(dev, PCOPRS1_CMD_OK) < 0)
+			return -1;
+		c = PCOPRS1_CMD_CHANNEL(ch);
+		if (remocon_send(dev, &c, 1) < 0)
+			return -1;
+		if (remocon_expect(dev, PCOPRS1_CMD_OK) < 0)
+			return -1;
+		if (remocon_send(dev, data, sz) < 0)
+			return TRANSMIT_ERR_SENT;
+		if (remocon_expect_timeout(dev, PCOPRS1_CMD_DATA_COMPLETION,
+					   IO_TIMEOUT_MS + lcdev_signal_ms(sz)) < 0)
+			return TRANSMIT_ERR_SENT;
+	}
+
+	return 0;
+}
+
+/*
+ * retry after resynchronizing with the device
+ * the signal is never sent again once the data is handed over, as the
+ * second one would toggle the appliance back (power etc.)
+ */
+int lcdev_transmit(struct lcdev *dev, int ch,
+		   const unsigned char *data, size_t sz)
+{
+	int r;
+	int i;
+
+	for (i = 0; ; i++) {
+		if ((r = transmit_once(dev, ch, data, sz)) >= 0)
+			return r;
+		if (r == TRANSMIT_ERR_SENT) {
+			if (!lcdev_is_canceled(dev))
+				lcdev_resync(dev);
+			return -1;
+		}
+		if (lcdev_is_canceled(dev) || (i == TRANSMIT_RETRY_MAX))
+			return r;
+		app_error("retrying (%d/%d) ...\n", i + 1, TRANSMIT_RETRY_MAX);
+		lcdev_resync(dev);
+	}
+}
+
+/*
+ * pipelined transmit (see lemon_squash.h)
+ */
+
+/*
+ * the acks of the frames in flight can't be trusted after an error.
+ * drop them with the window and start over from sequence 0.
+ */
+static void pipe_reset(struct lcdev *dev)
+{
+	if (!lcdev_is_canceled(dev))
+		lcdev_resync(dev);
+	dev->pipe.n_inflight = 0;
+	dev->pipe.next_seq = 0;
+}
+
+static int pipe_wait_ack(struct lcdev *dev)
+{
+	unsigned char resp[2];
+	unsigned char seq = dev->pipe.seq[0];
+	int busy_ms = dev->pipe.busy_ms[0];
+
+	if (dev->pipe.n_inflight == 0)
+		return 0;
+	dev->pipe.n_inflight--;
+	memmove(dev->pipe.seq, dev->pipe.seq + 1, dev->pipe.n_inflight);
+	memmove(dev->pipe.busy_ms, dev->pipe.busy_ms + 1,
+		sizeof(int) * dev->pipe.n_inflight);
+
+	if (dev->is_virtual)
+		return 0;
+
+	if (remocon_read_timeout(dev, resp, sizeof(resp),
+				 IO_TIMEOUT_MS + busy_ms) < 0)
+		goto err;
+	if (resp[1] != seq) {
+		app_error("frame %d: got the response for %d\n", seq, resp[1]);
+		goto err;
+	}
+	if (resp[0] == LEMON_SQUASH_RESP_NAK) {
+		app_error("frame %d: rejected by the device\n", seq);
+		goto err;
+	} else if (resp[0] != LEMON_SQUASH_RESP_ACK) {
+		app_error("frame %d: bad response '%c'(0x%02x)\n",
+			  seq, resp[0], resp[0]);
+		goto err;
+	}
+	return 0;
+
+err:
+	pipe_reset(dev);
+	return -1;
+}
+
+int lcdev_pipe_flush(struct lcdev *dev)
+{
+	int r = 0;
+
+	while (dev->pipe.n_inflight)
+		if (pipe_wait_ack(dev) < 0)
+			r = -1;
+	return r;
+}
+
+int lcdev_pipe_transmit(struct lcdev *dev, int op, int ch,
+			const unsigned char *data, size_t sz,
+			int sig_ms, int gap_ms)
+{
+	unsigned char hdr[LEMON_SQUASH_FRAME_HDR_LEN];
+	unsigned char sum = 0;
+	size_t i;
+
+	if (sz > 0xffff) {
+		app_error("invalid data len %zu\n", sz);
+		return -1;
+	}
+	/* the window is full. wait for the oldest one */
+	if ((dev->pipe.n_inflight == LEMON_SQUASH_WINDOW) &&
+	    (pipe_wait_ack(dev) < 0))
+		return -1;
+
+	hdr[0] = LEMON_SQUASH_CMD_FRAME;
+	hdr[1] = dev->pipe.next_seq;
+	hdr[2] = op;
+	hdr[3] = PCOPRS1_CMD_CHANNEL(ch);
+	hdr[4] = (unsigned char)(sz >> 8);
+	hdr[5] = (unsigned char)sz;
+	hdr[6] = (unsigned char)(gap_ms >> 8);
+	hdr[7] = (unsigned char)gap_ms;
+	for (i = 1; i < sizeof(hdr); i++)
+		sum += hdr[i];
+	for (i = 0; i < sz; i++)
+		sum += data[i];
+
+	if ((remocon_send(dev, hdr, sizeof(hdr)) < 0) ||
+	    (remocon_send(dev, data, sz) < 0) ||
+	    (remocon_send(dev, &sum, 1) < 0)) {
+		pipe_reset(dev);
+		return -1;
+	}
+
+	dev->pipe.busy_ms[dev->pipe.n_inflight] = sig_ms + gap_ms;
+	dev->pipe.seq[dev->pipe.n_inflight++] = dev->pipe.next_seq++;
+	return 0;
+}
+
+/*
+ * pipelined transmit of the waveform.  run-length coded with -rle
+ */
+int lcdev_pipe_transmit_data(struct lcdev *dev, int ch,
+			     const unsigned char *data, size_t sz, int gap_ms)
+{
+	unsigned char rle[sz];
+	size_t len;
+
+	if (dev->use_rle && !lcrle_encode(rle, sz, data, sz, &len))
+		return lcdev_pipe_transmit(dev, LEMON_SQUASH_CMD_TRANSMIT_RLE,
+					   ch, rle, len, lcdev_signal_ms(sz),
+					   gap_ms);
+	return lcdev_pipe_transmit(dev, LEMON_SQUASH_CMD_TRANSMIT2, ch,
+				   data, sz, lcdev_signal_ms(sz), gap_ms);
+}
+
+/*
+ * the device closes the capture at the end of the signal
+ * the rest of @data is filled with 0.  returns the received length
+ */
+static int receive_idle(struct lcdev *dev, unsigned char *data, size_t sz)
+{
+	unsigned char buf[2];
+	size_t len;
+
+	if ((sz % LEMON_SQUASH_DATA_UNIT_LEN != 0) ||
+	    (sz / LEMON_SQUASH_DATA_UNIT_LEN > 0xff)) {
+		app_error("invalid data len %zu\n", sz);
+		return -1;
+	}
+	buf[0] = LEMON_SQUASH_CMD_RECEIVE_IDLE;
+	buf[1] = sz / LEMON_SQUASH_DATA_UNIT_LEN;
+	if ((remocon_send(dev, &buf[0], 1) < 0) ||
+	    (remocon_expect(dev, PCOPRS1_CMD_OK) < 0) ||
+	    (remocon_send(dev, &buf[1], 1) < 0) ||
+	    (remocon_expect(dev, PCOPRS1_CMD_OK) < 0))
+		return -1;
+	buf[0] = dev->idle_ms;
+	if ((remocon_send(dev, &buf[0], 1) < 0) ||
+	    (remocon_expect(dev, PCOPRS1_CMD_OK) < 0) ||
+	    (remocon_wait_signal(dev) < 0) ||
+	    (remocon_read(dev, buf, 2) < 0))
+		return -1;
+
+	len = ((size_t)buf[0] << 8) | buf[1];
+	if (len > sz) {
+		app_error("too long data (%zu)\n", len);
+		return -1;
+	}
+	if (remocon_read_timeout(dev, data, len,
+				 IO_TIMEOUT_MS + lcdev_signal_ms(len)) < 0)
+		return -1;
+	if (remocon_expect(dev, PCOPRS1_CMD_DATA_COMPLETION) < 0)
+		return -1;
+	memset(data + len, 0, sz - len);
+
+	app_debug(LEMON_CORN_DEV, 1, "received %zu bytes\n", len);
+	return len;
+}
+
+static int receive_fixed(struct lcdev *dev, unsigned char *data, size_t sz)
+{
+	unsigned char c;
+	int read_len;
+
+	if (sz == PCOPRS1_DATA_LEN) {
+		c = PCOPRS1_CMD_RECEIVE;
+		if (remocon_send(dev, &c, 1) < 0)
+			return -1;
+		if (remocon_expect(dev, PCOPRS1_CMD_OK) < 0)
+			return -1;
+		if (remocon_wait_signal(dev) < 0)
+			return -1;
+		if ((read_len = remocon_read_timeout(dev, data, sz,
+				IO_TIMEOUT_MS + lcdev_signal_ms(sz))) < 0)
+			return -1;
+		if (remocon_expect(dev, PCOPRS1_CMD_DATA_COMPLETION) < 0)
+			return -1;
+	} else {
+		if (sz % LEMON_SQUASH_DATA_UNIT_LEN != 0) {
+			app_error("invalid data len %zu\n", sz);
+			return -1;
+		}
+		c = LEMON_SQUASH_CMD_RECEIVE2;
+		if (remocon_send(dev, &c, 1) < 0)
+			return -1;
+		if (remocon_expect(dev, PCOPRS1_CMD_OK) < 0)
+			return -1;
+		c = sz / LEMON_SQUASH_DATA_UNIT_LEN;
+		if (remocon_send(dev, &c, 1) < 0)
+			return -1;
+		if (remocon_expect(dev, PCOPRS1_CMD_OK) < 0)
+			return -1;
+		if (remocon_wait_signal(dev) < 0)
+			return -1;
+		if ((read_len = remocon_read_timeout(dev, data, sz,
+				IO_TIMEOUT_MS + lcdev_signal_ms(sz))) < 0)
+			return -1;
+		if (remocon_expect(dev, PCOPRS1_CMD_DATA_COMPLETION) < 0)
+			return -1;
+	}
+
+	return read_len;
+}
+
+/*
+ * the pending receive is canceled on any error
+ */
+int lcdev_receive(struct lcdev *dev, unsigned char *data, size_t sz)
+{
+	int r;
+
+	if ((dev->idle_ms > 0) && !dev->is_virtual)
+		r = receive_idle(dev, data, sz);
+	else
+		r = receive_fixed(dev, data, sz);
+	if (r < 0)
+		receive_cancel(dev);
+	return r;
+}
+
+/*
+ * receive the runs streamed by the device
+ * the raw runs are stored in @rle (@rle_len bytes) as well.
+ * returns the number of runs
+ */
+int lcdev_receive_edge(struct lcdev *dev, unsigned int *runs, int max_runs,
+		       unsigned char *rle, size_t *rle_len)
+{
+	unsigned char c;
+	size_t len = 0, start = 0;
+	int n_runs = 0;
+
+	c = LEMON_SQUASH_CMD_RECEIVE_EDGE;
+	if (remocon_send(dev, &c, 1) < 0)
+		return -1;
+	if ((remocon_expect(dev, PCOPRS1_CMD_OK) < 0) ||
+	    (remocon_wait_signal(dev) < 0))
+		goto err;
+
+	while (1) {
+		const unsigned char *p = rle + start;
+		unsigned long run;
+
+		if (len == (size_t)max_runs * LCRLE_VARINT_LEN_MAX) {
+			app_error("too long edge stream\n");
+			goto err;
+		}
+		if (remocon_read(dev, rle + len, 1) < 0)
+			goto err;
+		if (rle[len++] & 0x80)
+			continue;
+
+		/* a varint completed */
+		if (lcrle_get_run(&p, rle + len, &run) < 0) {
+			app_error("broken edge stream\n");
+			goto err;
+		}
+		start = len;
+		if ((run == 0) && (n_runs > 0))
+			break;	/* end of the stream */
+		if (n_runs == max_runs) {
+			app_error("too many edges\n");
+			goto err;
+		}
+		runs[n_runs++] = run;
+	}
+	if (remocon_expect(dev, PCOPRS1_CMD_DATA_COMPLETION) < 0)
+		goto err;
+
+	*rle_len = len - 1;	/* without the terminator */
+	return n_runs;
+
+err:
+	receive_cancel(dev);
+	return -1;
+}
+
+/*
+ * receive the edge stream as a bitmap
+ */
+int lcdev_receive_edge_bitmap(struct lcdev *dev, unsigned char *data,
+			      size_t sz)
+{
+	unsigned int runs[LCDEV_EDGE_RUN_MAX];
+	unsigned char rle[LCDEV_EDGE_RUN_MAX * LCRLE_VARINT_LEN_MAX];
+	size_t rle_len;
+
+	if (lcdev_receive_edge(dev, runs, LCDEV_EDGE_RUN_MAX, rle, &rle_len) < 0)
+		return -1;
+	if (lcrle_decode(data, sz, rle, rle_len) < 0)
+		return -1;
+	return sz;
+}
+
+/*
+ * transmit the command uploaded to the device (@sz bytes of signal)
+ * returns 1 if the device doesn't know the index.  on an error the
+ * signal may be out already, so resynchronize but never fall back.
+ */
+int lcdev_transmit_idx(struct lcdev *dev, int ch, int idx, size_t sz)
+{
+	unsigned char buf[3];
+	unsigned char ex_ary[2];
+	int r;
+
+	buf[0] = LEMON_SQUASH_CMD_TRANSMIT_IDX;
+	buf[1] = (unsigned char)idx;
+	buf[2] = PCOPRS1_CMD_CHANNEL(ch);
+	if (remocon_send(dev, buf, sizeof(buf)) < 0)
+		goto err;
+
+	ex_ary[0] = PCOPRS1_CMD_DATA_COMPLETION;
+	ex_ary[1] = LEMON_SQUASH_RESP_NAK;
+	if ((r = remocon_expect2_timeout(dev, ex_ary, sizeof(ex_ary),
+			IO_TIMEOUT_MS + lcdev_signal_ms(sz))) < 0)
+		goto err;
+	return r;
+
+err:
+	if (!lcdev_is_canceled(dev))
+		lcdev_resync(dev);
+	return -1;
+}
+
+
+/*
+ * upload the image of the device library (see lemon_corn_dlib.h)
+ * returns 1 if the image is too large for the device
+ */
+int lcdev_upload(struct lcdev *dev, const unsigned char *img, size_t img_size)
+{
+	unsigned char buf[3];
+	unsigned char ex_ary[2];
+	int r;
+
+	if (img_size > 0xffff) {
+		app_error("too large image (%zu bytes)\n", img_size);
+		return -1;
+	}
+	buf[0] = LEMON_SQUASH_CMD_UPLOAD;
+	buf[1] = (unsigned char)(img_size >> 8);
+	buf[2] = (unsigned char)img_size;
+	if (remocon_send(dev, buf, sizeof(buf)) < 0)
+		return -1;
+	ex_ary[0] = PCOPRS1_CMD_OK;
+	ex_ary[1] = LEMON_SQUASH_RESP_NAK;
+	if ((r = remocon_expect2(dev, ex_ary, sizeof(ex_ary))) != 0)
+		return r;
+	if (remocon_send(dev, img, img_size) < 0)
+		return -1;
+	if (remocon_expect(dev, PCOPRS1_CMD_DATA_COMPLETION) < 0)
+		return -1;
+	return 0;
+}
+
+/*
+ * wait for the device to come up, then switch to the fastest link speed
+ * up to @baud
+ */
+int lcdev_setup(struct lcdev *dev, int baud)
+{
+	unsigned char c;
+	unsigned char ex_ary[2];
+
+	if (dev->is_arduino && !dev->is_virtual) {
+		/* the device may be resetting after the open */
+		if (serial_wait_ready(dev->fd, ARDUINO_SETUP_WAIT_MS) < 0)
+			return -1;
+	} else {
+		c = PCOPRS1_CMD_LED;
+		if (remocon_send(dev, &c, 1) < 0)
+			return -1;
+		ex_ary[0] = PCOPRS1_CMD_LED_OK;
+		ex_ary[1] = PCOPRS1_CMD_OK;
+		if (remocon_expect2(dev, ex_ary, sizeof(ex_ary)) < 0)
+			return -1;
+	}
+
+	if (!dev->is_proxy && !dev->is_virtual)
+		dev->baud = serial_negotiate(dev->fd, baud);
+	return 0;
+}
+
+/*
+ * safe in a signal handler or from another thread.  the exchange in
+ * progress fails at its next step and is not retried, and so do the
+ * following ones until lcdev_resync().
+ */
+void lcdev_cancel(struct lcdev *dev)
+{
+	__atomic_store_n(&dev->canceled, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * open / close
+ */
+void lcdev_init(struct lcdev *dev)
+{
+	memset(dev, 0, sizeof(*dev));
+	dev->idle_ms = -1;
+	dev->rcv_timeout_ms = -1;
+}
+
+int lcdev_open(struct lcdev *dev, const char *devname, int no_reset)
+{
+	if ((dev->fd = serial_open(devname, &dev->tio_old)) < 0)
+		return -1;
+	if (no_reset)
+		serial_keep_dtr(dev->fd, &dev->tio_old);
+	dev->is_proxy = 0;
+	return 0;
+}
+
+int lcdev_open_proxy(struct lcdev *dev, const char *host_name,
+		     const char *port_str)
+{
+	struct addrinfo ai_hint, *aip;
+	int fd;
+	int r;
+
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		app_error("socket() failed\n");
+		return -1;
+	}
+
+	memset(&ai_hint, 0, sizeof(struct addrinfo));
+	ai_hint.ai_family = AF_INET;
+	ai_hint.ai_socktype = SOCK_STREAM;
+	ai_hint.ai_flags = 0;
+	ai_hint.ai_protocol = 0;
+
+	if ((r = getaddrinfo(host_name, port_str, &ai_hint, &aip)) < 0) {
+		app_error("getaddrinfo: %s\n", gai_strerror(r));
+		close(fd);
+		return -1;
+	}
+
+	if (connect(fd, aip->ai_addr, aip->ai_addrlen) < 0) {
+		app_error("connect() failed\n");
+		close(fd);
+		freeaddrinfo(aip);
+		return -1;
+	}
+
+	freeaddrinfo(aip);
+
+	dev->fd = fd;
+	dev->is_proxy = 1;
+	return 0;
+}
+
+void lcdev_close(struct lcdev *dev)
+{
+	if (dev->fd == 0)	/* virtual, or not opened */
+		return;
+	if (dev->is_proxy) {
+		close(dev->fd);
+	} else {
+		/* the device keeps the rate over the close with -noreset */
+		if (dev->baud)
+			serial_restore_baud(dev->fd, dev->baud);
+		serial_close(dev->fd, &dev->tio_old);
+	}
+	dev->fd = 0;
+	dev->baud = 0;
+}
@@ -0,0 +1,82 @@
+#ifndef _LEMON_CORN_DEV_H
+#define _LEMON_CORN_DEV_H
+
+#include <stddef.h>
+#include <termios.h>
+#include "lemon_squash.h"
+
+/*
+ * device handle
+ *
+ *   a PC-OP-RS1 or a lemon_squash board, on a serial port or behind
+ *   serial_proxyd.  all the state of the link is in the handle, so that
+ *   each device can be driven from its own thread.  a handle is not to
+ *   be shared by threads, except for lcdev_cancel().
+ *
+ *   virtual (@is_virtual): nothing is sent, and the received data is
+ *   read from the standard input.
+ */
+#define LCDEV_IO_TIMEOUT_MS	2000
+#define LCDEV_EDGE_RUN_MAX	2048
+
+struct lcdev {
+	int fd;			/* 0 if not opened */
+	struct termios tio_old;
+	int is_proxy;
+	int is_arduino;
+	int is_virtual;
+	int use_rle;
+	int idle_ms;		/* -1 if the capture window is fixed */
+	int rcv_timeout_ms;	/* -1 if no limit */
+	int baud;		/* negotiated. 0 if not */
+	int canceled;		/* atomic. see lcdev_cancel() */
+	struct {
+		unsigned char next_seq;
+		int n_inflight;
+		unsigned char seq[LEMON_SQUASH_WINDOW];	/* oldest first */
+		int busy_ms[LEMON_SQUASH_WINDOW];
+	} pipe;
+};
+
+static inline int lcdev_is_canceled(const struct lcdev *dev)
+{
+	return __atomic_load_n(&dev->canceled, __ATOMIC_ACQUIRE);
+}
+
+/* the signal is sampled every 100us */
+static inline int lcdev_signal_ms(size_t sz)
+{
+	return sz * 8 / 10;
+}
+
+extern void lcdev_init(struct lcdev *dev);
+extern int lcdev_open(struct lcdev *dev, const char *devname, int no_reset);
+extern int lcdev_open_proxy(struct lcdev *dev, const char *host_name,
+			    const char *port_str);
+extern void lcdev_close(struct lcdev *dev);
+extern int lcdev_setup(struct lcdev *dev, int baud);
+extern void lcdev_cancel(struct lcdev *dev);
+extern int lcdev_resync(struct lcdev *dev);
+
+extern int lcdev_transmit(struct lcdev *dev, int ch,
+			  const unsigned char *data, size_t sz);
+extern int lcdev_transmit_idx(struct lcdev *dev, int ch, int idx, size_t sz);
+extern int lcdev_upload(struct lcdev *dev, const unsigned char *img,
+			size_t img_size);
+
+extern int lcdev_pipe_transmit(struct lcdev *dev, int op, int ch,
+			       const unsigned char *data, size_t sz,
+			       int sig_ms, int gap_ms);
+extern int lcdev_pipe_transmit_data(struct lcdev *dev, int ch,
+				    const unsigned char *data, size_t sz,
+				    int gap_ms);
+extern int lcdev_pipe_flush(struct lcdev *dev);
+
+extern int lcdev_receive(struct lcdev *dev, unsigned char *data, size_t sz);
+extern int lcdev_receive_edge(struct lcdev *dev, unsigned int *runs,
+			      int max_runs, unsigned char *rle,
+			      size_t *rle_len);
+extern int lcdev_receive_edge_bitmap(struct lcdev *dev, unsigned char *data,
+				     size_t sz);
+
+#endif	/* _LEMON_CORN_DEV_H */
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "string_util.h"
+#include "lemon_corn_dlib.h"
+
+#include "debug.h"
+
+/* BSD checksum */
+static unsigned short data_sum(const unsigned char *data, size_t sz)
+{
+	unsigned short sum = 0;
+	size_t i;
+
+	for (i = 0; i < sz; i++)
+		sum = ((sum >> 1) | (sum << 15)) + data[i];
+	return sum;
+}
+
+/*
+ * build the device image of the commands @tags
+ * the index of each command is its position in @tags.
+ * @img is allocated, and must be freed by the caller.
+ */
+int lcdlib_build(struct lcdlib *dlib, struct lcdata *lcdata,
+		 char *const *tags, int n_tags,
+		 unsigned char **img, size_t *img_size)
+{
+	struct lcdata_ent ent;
+	unsigned char *p;
+	size_t sz;
+	int i;
+
+	if (n_tags > LCDLIB_ENT_MAX) {
+		app_error("too many commands for the device (%d)\n", n_tags);
+		return -1;
+	}
+
+	sz = 1 + n_tags * 2;
+	for (i = 0; i < n_tags; i++) {
+		if (lcdata_get_cmd_by_tag(lcdata, tags[i], &ent) < 0) {
+			app_error("Unknown command: %s\n", tags[i]);
+			return -1;
+		}
+		sz += ent.data_size;
+	}
+	if ((*img = malloc(sz)) == NULL) {
+		app_error("%s(): memory allocation failed.\n", __func__);
+		return -1;
+	}
+	*img_size = sz;
+
+	dlib->n_ent = n_tags;
+	(*img)[0] = (unsigned char)n_tags;
+	p = *img + 1 + n_tags * 2;
+	for (i = 0; i < n_tags; i++) {
+		struct lcdlib_ent *dent = &dlib->ents[i];
+
+		lcdata_get_cmd_by_tag(lcdata, tags[i], &ent);
+		lcdata_ent_expand(&ent, p);
+		(*img)[1 + i * 2]     = (unsigned char)(ent.data_size >> 8);
+		(*img)[1 + i * 2 + 1] = (unsigned char)ent.data_size;
+
+		memset(dent->tag, 0, LEMON_CORN_TAG_LEN);
+		strcpy(dent->tag, tags[i]);
+		dent->len = ent.data_size;
+		dent->sum = data_sum(p, ent.data_size);
+		p += ent.data_size;
+	}
+
+	return 0;
+}
+
+/*
+ * returns the index of the command on the device,
+ * or -1 if it isn't uploaded or has changed since the upload
+ */
+int lcdlib_lookup(const struct lcdlib *dlib, const char *tag,
+		  const unsigned char *data, size_t sz)
+{
+	int i;
+
+	for (i = 0; i < dlib->n_ent; i++) {
+		const struct lcdlib_ent *dent = &dlib->ents[i];
+
+		if (strcmp(dent->tag, tag))
+			continue;
+		if ((dent->len != sz) || (dent->sum != data_sum(data, sz)))
+			return -1;
+		return i;
+	}
+	return -1;
+}
+
+/*
+ * no file is not an error
+ */
+int lcdlib_load(struct lcdlib *dlib, const char *fn)
+{
+	FILE *fp;
+	char line[128];
+	int lineno = 0;
+
+	dlib->n_ent = 0;
+	if ((fp = fopen(fn, "r")) == NULL)
+		return (errno == ENOENT) ? 0 : -1;
+
+	while (fgets(line, sizeof(line), fp) &&
+	       (dlib->n_ent < LCDLIB_ENT_MAX)) {
+		struct lcdlib_ent *dent = &dlib->ents[dlib->n_ent];
+
+		lineno++;
+		strchomp(line);
+		memset(dent->tag, 0, LEMON_CORN_TAG_LEN);
+		if (sscanf(line, "%31s %hx %hu",
+			   dent->tag, &dent->sum, &dent->len) != 3) {
+			app_error("%s:%d: invalid line\n", fn, lineno);
+			dlib->n_ent = 0;	/* indexes are broken */
+			break;
+		}
+		dlib->n_ent++;
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+int lcdlib_save(const struct lcdlib *dlib, const char *fn)
+{
+	FILE *fp;
+	int i;
+
+	if ((fp = fopen(fn, "w")) == NULL) {
+		app_error("device library file open failed: %s (%s)\n",
+			  fn, strerror(errno));
+		return -1;
+	}
+	for (i = 0; i < dlib->n_ent; i++)
+		fprintf(fp, "%s %04x %u\n", dlib->ents[i].tag,
+			dlib->ents[i].sum, dlib->ents[i].len);
+	if (fclose(fp) == EOF) {
+		app_error("device library file write failed: %s (%s)\n",
+			  fn, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef _LEMON_CORN_DLIB_H
+#define _LEMON_CORN_DLIB_H
+
+#include <stddef.h>
+#include "lemon_corn_data.h"
+
+/*
+ * on-device library
+ *
+ *   a set of commands uploaded to the lemon_squash device once, then
+ *   transmitted by index.  the host keeps the tags of the uploaded
+ *   commands with their checksum in a sidecar file, so that a command
+ *   re-learned after the upload is not sent by index.
+ *
+ *   [device image]  (see LEMON_SQUASH_CMD_UPLOAD)
+ *     n_ent:  1 byte
+ *     len:    the length of each data (n_ent * 2 bytes, big endian)
+ *     data:   concatenated
+ *
+ *   [sidecar file]
+ *     "<tag> <sum_hex> <len>" per line, in the order of the index
+ */
+#define LCDLIB_ENT_MAX		255
+
+struct lcdlib_ent {
+	char tag[LEMON_CORN_TAG_LEN];
+	unsigned short sum;
+	unsigned short len;
+};
+
+struct lcdlib {
+	int n_ent;
+	struct lcdlib_ent ents[LCDLIB_ENT_MAX];
+};
+
+extern int
+lcdlib_build(struct lcdlib *dlib, struct lcdata *lcdata,
+	     char *const *tags, int n_tags,
+	     unsigned char **img, size_t *img_size);
+extern int
+lcdlib_lookup(const struct lcdlib *dlib, const char *tag,
+	      const unsigned char *data, size_t sz);
+extern int
+lcdlib_load(struct lcdlib *dlib, const char *fn);
+extern int
+lcdlib_save(const struct lcdlib *dlib, const char *fn);
+
+#endif	/* _LEMON_CORN_DLIB_H */
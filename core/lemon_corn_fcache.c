@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "file_util.h"
+#include "lemon_corn_fcache.h"
+
+#include "debug.h"
+
+#define LCFCACHE_MAGIC		"LCFC"
+#define LCFCACHE_MAGIC_LEN	4
+#define LCFCACHE_HDR_LEN	(LCFCACHE_FMT_LEN + 8 + 8 + 2)
+
+static unsigned int hash(const char *fmt, unsigned long long custom,
+			 unsigned long long cmd)
+{
+	unsigned int h = 2166136261u;	/* FNV-1a */
+	int i;
+
+	for (i = 0; (i < LCFCACHE_FMT_LEN) && fmt[i]; i++)
+		h = (h ^ (unsigned char)fmt[i]) * 16777619u;
+	for (i = 0; i < 8; i++)
+		h = (h ^ (unsigned char)(custom >> (i * 8))) * 16777619u;
+	for (i = 0; i < 8; i++)
+		h = (h ^ (unsigned char)(cmd >> (i * 8))) * 16777619u;
+	return h;
+}
+
+static inline int ent_match(const struct lcfcache_ent *ent, const char *fmt,
+			    unsigned long long custom, unsigned long long cmd)
+{
+	return (ent->custom == custom) && (ent->cmd == cmd) &&
+	       !strncmp(ent->fmt, fmt, LCFCACHE_FMT_LEN);
+}
+
+/*
+ * LRU list
+ */
+static void lru_unlink(struct lcfcache *fc, int id)
+{
+	struct lcfcache_ent *ent = &fc->ents[id];
+
+	if (ent->prev >= 0)
+		fc->ents[ent->prev].next = ent->next;
+	else
+		fc->head = ent->next;
+	if (ent->next >= 0)
+		fc->ents[ent->next].prev = ent->prev;
+	else
+		fc->tail = ent->prev;
+}
+
+static void lru_push_head(struct lcfcache *fc, int id)
+{
+	struct lcfcache_ent *ent = &fc->ents[id];
+
+	ent->prev = -1;
+	ent->next = fc->head;
+	if (fc->head >= 0)
+		fc->ents[fc->head].prev = id;
+	fc->head = id;
+	if (fc->tail < 0)
+		fc->tail = id;
+}
+
+/*
+ * hash chain
+ */
+static void htab_unlink(struct lcfcache *fc, int id)
+{
+	struct lcfcache_ent *ent = &fc->ents[id];
+	int *pp = &fc->htab[hash(ent->fmt, ent->custom, ent->cmd) &
+			    (fc->n_htab - 1)];
+
+	for (; *pp >= 0; pp = &fc->ents[*pp].hnext) {
+		if (*pp == id) {
+			*pp = ent->hnext;
+			return;
+		}
+	}
+}
+
+int lcfcache_init(struct lcfcache *fc, int size)
+{
+	int i;
+
+	memset(fc, 0, sizeof(*fc));
+	for (fc->n_htab = 1; fc->n_htab < size * 2; fc->n_htab <<= 1)
+		;
+	fc->ents = calloc(size, sizeof(*fc->ents));
+	fc->htab = malloc(sizeof(int) * fc->n_htab);
+	if ((fc->ents == NULL) || (fc->htab == NULL)) {
+		app_error("%s(): memory allocation failed.\n", __func__);
+		lcfcache_free(fc);
+		return -1;
+	}
+	for (i = 0; i < fc->n_htab; i++)
+		fc->htab[i] = -1;
+	fc->size = size;
+	fc->head = fc->tail = -1;
+
+	return 0;
+}
+
+void lcfcache_free(struct lcfcache *fc)
+{
+	int i;
+
+	for (i = 0; i < fc->n_ent; i++)
+		free(fc->ents[i].data);
+	free(fc->ents);
+	free(fc->htab);
+	memset(fc, 0, sizeof(*fc));
+}
+
+/*
+ * returns the cached entry, or NULL if not cached
+ */
+const struct lcfcache_ent *
+lcfcache_lookup(struct lcfcache *fc, const char *fmt,
+		unsigned long long custom, unsigned long long cmd)
+{
+	int id;
+
+	if (fc->size == 0)
+		return NULL;
+
+	for (id = fc->htab[hash(fmt, custom, cmd) & (fc->n_htab - 1)];
+	     id >= 0; id = fc->ents[id].hnext) {
+		if (ent_match(&fc->ents[id], fmt, custom, cmd)) {
+			if (fc->head != id) {
+				lru_unlink(fc, id);
+				lru_push_head(fc, id);
+				fc->is_dirty = 1;
+			}
+			return &fc->ents[id];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * add the pattern as the most recently used one
+ * the least recently used entry is dropped if the cache is full.
+ */
+int lcfcache_insert(struct lcfcache *fc, const char *fmt,
+		    unsigned long long custom, unsigned long long cmd,
+		    const unsigned char *data, size_t sz)
+{
+	struct lcfcache_ent *ent;
+	unsigned char *copy;
+	unsigned int h;
+	int id;
+
+	if (fc->size == 0)
+		return -1;
+	if (lcfcache_lookup(fc, fmt, custom, cmd))
+		return 0;	/* already cached */
+
+	if ((copy = malloc(sz)) == NULL) {
+		app_error("%s(): memory allocation failed.\n", __func__);
+		return -1;
+	}
+	memcpy(copy, data, sz);
+
+	if (fc->n_ent < fc->size) {
+		id = fc->n_ent++;
+	} else {
+		id = fc->tail;
+		lru_unlink(fc, id);
+		htab_unlink(fc, id);
+		free(fc->ents[id].data);
+	}
+
+	ent = &fc->ents[id];
+	memset(ent->fmt, 0, LCFCACHE_FMT_LEN);
+	memcpy(ent->fmt, fmt, strnlen(fmt, LCFCACHE_FMT_LEN));
+	ent->custom = custom;
+	ent->cmd = cmd;
+	ent->data = copy;
+	ent->data_size = sz;
+
+	h = hash(ent->fmt, custom, cmd) & (fc->n_htab - 1);
+	ent->hnext = fc->htab[h];
+	fc->htab[h] = id;
+	lru_push_head(fc, id);
+	fc->is_dirty = 1;
+
+	return 0;
+}
+
+static unsigned long long get_be64(const unsigned char *p)
+{
+	unsigned long long v = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+static void put_be64(unsigned char *p, unsigned long long v)
+{
+	int i;
+
+	for (i = 7; i >= 0; i--, v >>= 8)
+		p[i] = (unsigned char)v;
+}
+
+/*
+ * no file is not an error
+ */
+int lcfcache_load(struct lcfcache *fc, const char *fn)
+{
+	void *img;
+	ssize_t img_size;
+	unsigned char **ents;
+	unsigned char *p, *endp;
+	int n = 0;
+	int i;
+
+	if ((img_size = try_get_file_image(&img, fn)) <= 0)
+		return img_size;
+	if ((img_size < LCFCACHE_MAGIC_LEN) ||
+	    memcmp(img, LCFCACHE_MAGIC, LCFCACHE_MAGIC_LEN)) {
+		app_error("bad forge cache file: %s\n", fn);
+		free(img);
+		return -1;
+	}
+
+	if ((ents = malloc(sizeof(*ents) * fc->size)) == NULL) {
+		app_error("%s(): memory allocation failed.\n", __func__);
+		free(img);
+		return -1;
+	}
+
+	/* the file begins with the most recently used one */
+	endp = (unsigned char *)img + img_size;
+	for (p = (unsigned char *)img + LCFCACHE_MAGIC_LEN;
+	     (p + LCFCACHE_HDR_LEN <= endp) && (n < fc->size); ) {
+		size_t len = ((size_t)p[LCFCACHE_HDR_LEN - 2] << 8) |
+			     p[LCFCACHE_HDR_LEN - 1];
+		if (p + LCFCACHE_HDR_LEN + len > endp)
+			break;
+		ents[n++] = p;
+		p += LCFCACHE_HDR_LEN + len;
+	}
+	for (i = n - 1; i >= 0; i--) {
+		char fmt[LCFCACHE_FMT_LEN + 1] = { 0 };
+		size_t len = ((size_t)ents[i][LCFCACHE_HDR_LEN - 2] << 8) |
+			     ents[i][LCFCACHE_HDR_LEN - 1];
+
+		memcpy(fmt, ents[i], LCFCACHE_FMT_LEN);
+		lcfcache_insert(fc, fmt,
+				get_be64(ents[i] + LCFCACHE_FMT_LEN),
+				get_be64(ents[i] + LCFCACHE_FMT_LEN + 8),
+				ents[i] + LCFCACHE_HDR_LEN, len);
+	}
+	fc->is_dirty = 0;
+
+	free(ents);
+	free(img);
+	return 0;
+}
+
+int lcfcache_save(const struct lcfcache *fc, const char *fn)
+{
+	int fd;
+	int id;
+
+	fd = open(fn, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+	if (fd < 0) {
+		app_error("forge cache file open failed: %s (%s)\n",
+			  fn, strerror(errno));
+		return -1;
+	}
+
+	if (write(fd, LCFCACHE_MAGIC, LCFCACHE_MAGIC_LEN) < 0)
+		goto err;
+	for (id = fc->head; id >= 0; id = fc->ents[id].next) {
+		const struct lcfcache_ent *ent = &fc->ents[id];
+		unsigned char hdr[LCFCACHE_HDR_LEN];
+
+		memcpy(hdr, ent->fmt, LCFCACHE_FMT_LEN);
+		put_be64(hdr + LCFCACHE_FMT_LEN, ent->custom);
+		put_be64(hdr + LCFCACHE_FMT_LEN + 8, ent->cmd);
+		hdr[LCFCACHE_HDR_LEN - 2] = (unsigned char)(ent->data_size >> 8);
+		hdr[LCFCACHE_HDR_LEN - 1] = (unsigned char)ent->data_size;
+		if ((write(fd, hdr, sizeof(hdr)) < 0) ||
+		    (write(fd, ent->data, ent->data_size) < 0))
+			goto err;
+	}
+
+	close(fd);
+	return 0;
+
+err:
+	app_error("forge cache file write failed: %s (%s)\n",
+		  fn, strerror(errno));
+	close(fd);
+	return -1;
+}
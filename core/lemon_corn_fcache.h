@@ -0,0 +1,58 @@
+#ifndef _LEMON_CORN_FCACHE_H
+#define _LEMON_CORN_FCACHE_H
+
+#include <stddef.h>
+
+/*
+ * LRU cache of forged patterns
+ *
+ *   keyed by (format, custom, cmd).  the cache can be saved to and loaded
+ *   from a file so that the patterns survive across processes.
+ *
+ *   [file]
+ *     magic:   "LCFC"
+ *     entries: from the most recently used one
+ *       fmt:    format tag (LCFCACHE_FMT_LEN, 0 padded)
+ *       custom: 8 bytes (big endian)
+ *       cmd:    8 bytes (big endian)
+ *       len:    the length of the data (big endian)
+ *       data:   size is @len
+ */
+#define LCFCACHE_FMT_LEN	8
+#define LCFCACHE_DEFAULT_SIZE	256
+
+struct lcfcache_ent {
+	char fmt[LCFCACHE_FMT_LEN];
+	unsigned long long custom, cmd;
+	unsigned char *data;
+	size_t data_size;
+	int prev, next;		/* LRU list */
+	int hnext;		/* hash chain */
+};
+
+struct lcfcache {
+	int size, n_ent;
+	struct lcfcache_ent *ents;
+	int *htab;
+	int n_htab;
+	int head, tail;		/* most / least recently used */
+	int is_dirty;
+};
+
+extern int
+lcfcache_init(struct lcfcache *fc, int size);
+extern void
+lcfcache_free(struct lcfcache *fc);
+extern const struct lcfcache_ent *
+lcfcache_lookup(struct lcfcache *fc, const char *fmt,
+		unsigned long long custom, unsigned long long cmd);
+extern int
+lcfcache_insert(struct lcfcache *fc, const char *fmt,
+		unsigned long long custom, unsigned long long cmd,
+		const unsigned char *data, size_t sz);
+extern int
+lcfcache_load(struct lcfcache *fc, const char *fn);
+extern int
+lcfcache_save(const struct lcfcache *fc, const char *fn);
+
+#endif	/* _LEMON_CORN_FCACHE_H */
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "lemon_corn_loop.h"
+
+#include "debug.h"
+
+int lcloop_init(struct lcloop *loop)
+{
+	loop->quit = 0;
+	if ((loop->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		app_error("epoll_create1() failed: %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+void lcloop_free(struct lcloop *loop)
+{
+	close(loop->epfd);
+}
+
+/*
+ * fails with EPERM if @w->fd can't be polled (a regular file)
+ */
+int lcloop_add(struct lcloop *loop, struct lcloop_watch *w)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = w;
+	return epoll_ctl(loop->epfd, EPOLL_CTL_ADD, w->fd, &ev);
+}
+
+int lcloop_del(struct lcloop *loop, struct lcloop_watch *w)
+{
+	return epoll_ctl(loop->epfd, EPOLL_CTL_DEL, w->fd, NULL);
+}
+
+/*
+ * dispatch the events until lcloop_quit()
+ * returns -1 if interrupted by a signal (errno EINTR) or on error
+ */
+int lcloop_run(struct lcloop *loop)
+{
+	struct epoll_event evs[LCLOOP_EVENTS_MAX];
+	int n, i;
+
+	loop->quit = 0;
+	while (!loop->quit) {
+		n = epoll_wait(loop->epfd, evs, LCLOOP_EVENTS_MAX, -1);
+		if (n < 0) {
+			if (errno != EINTR)
+				app_error("epoll_wait() failed: %s\n",
+					  strerror(errno));
+			return -1;
+		}
+		for (i = 0; (i < n) && !loop->quit; i++) {
+			struct lcloop_watch *w = evs[i].data.ptr;
+
+			w->cb(w);
+		}
+	}
+	return 0;
+}
+
+void lcloop_quit(struct lcloop *loop)
+{
+	loop->quit = 1;
+}
+
+/*
+ * timers
+ */
+int lcloop_timer_open(void)
+{
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (fd < 0)
+		app_error("timerfd_create() failed: %s\n", strerror(errno));
+	return fd;
+}
+
+/*
+ * the timer expires at once if @deadline_ms has passed
+ */
+int lcloop_timer_set(int fd, long long deadline_ms)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = deadline_ms / 1000;
+	its.it_value.tv_nsec = (deadline_ms % 1000) * 1000000;
+	if ((its.it_value.tv_sec == 0) && (its.it_value.tv_nsec == 0))
+		its.it_value.tv_nsec = 1;	/* 0 disarms */
+	return timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/*
+ * read the count of a timerfd or an eventfd
+ */
+unsigned long long lcloop_drain(int fd)
+{
+	uint64_t v;
+
+	if (read(fd, &v, sizeof(v)) != sizeof(v))
+		return 0;
+	return v;
+}
@@ -0,0 +1,37 @@
+#ifndef _LEMON_CORN_LOOP_H
+#define _LEMON_CORN_LOOP_H
+
+/*
+ * event loop
+ *
+ *   epoll over the watched fds.  @cb is called on the thread running
+ *   lcloop_run() when @fd is readable (or hung up), and may remove its
+ *   own watch.  the watches are the caller's.
+ *
+ *   timers are timerfds, set to a deadline in ms on CLOCK_MONOTONIC.
+ */
+#define LCLOOP_EVENTS_MAX	8
+
+struct lcloop_watch {
+	int fd;
+	void (*cb)(struct lcloop_watch *w);
+	void *priv;
+};
+
+struct lcloop {
+	int epfd;
+	int quit;
+};
+
+extern int lcloop_init(struct lcloop *loop);
+extern void lcloop_free(struct lcloop *loop);
+extern int lcloop_add(struct lcloop *loop, struct lcloop_watch *w);
+extern int lcloop_del(struct lcloop *loop, struct lcloop_watch *w);
+extern int lcloop_run(struct lcloop *loop);
+extern void lcloop_quit(struct lcloop *loop);
+
+extern int lcloop_timer_open(void);
+extern int lcloop_timer_set(int fd, long long deadline_ms);
+extern unsigned long long lcloop_drain(int fd);
+
+#endif	/* _LEMON_CORN_LOOP_H */
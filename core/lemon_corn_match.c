@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lemon_corn_data.h"
+#include "lemon_corn_match.h"
+
+#include "debug.h"
+
+/*
+ * bitmap helpers
+ */
+static int first_edge(const unsigned char *data, size_t sz)
+{
+	size_t i;
+
+	for (i = 0; i < sz; i++) {
+		if (data[i])
+			return i * 8 + __builtin_ctz(data[i]);
+	}
+	return -1;
+}
+
+static inline uint64_t load_le64(const unsigned char *data, size_t sz,
+				 size_t pos)
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i = 0; (i < 8) && (pos + i < sz); i++)
+		v |= (uint64_t)data[pos + i] << (i * 8);
+	return v;
+}
+
+/*
+ * shift the pattern so that its first rising edge comes to bit 0
+ */
+static void align_bitmap(uint64_t *dst, int n_words,
+			 const unsigned char *data, size_t sz)
+{
+	int off = first_edge(data, sz);
+	int w;
+
+	memset(dst, 0, n_words * sizeof(uint64_t));
+	if (off < 0)
+		return;
+
+	for (w = 0; w < n_words; w++) {
+		size_t bit = off + (size_t)w * 64;
+		size_t pos = bit / 8;
+		int sh = bit % 8;
+
+		if (pos >= sz)
+			break;
+		dst[w] = load_le64(data, sz, pos) >> sh;
+		if (sh && (pos + 8 < sz))
+			dst[w] |= (uint64_t)data[pos + 8] << (64 - sh);
+	}
+}
+
+static inline int hamming(const uint64_t *a, const uint64_t *b, int n_words)
+{
+	int d = 0;
+	int i;
+
+	/* plain loop so that the compiler can vectorize it */
+	for (i = 0; i < n_words; i++)
+		d += __builtin_popcountll(a[i] ^ b[i]);
+	return d;
+}
+
+/*
+ * LSH (bit sampling)
+ */
+static uint32_t xorshift32(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static uint32_t lsh_key(const int *pos, const uint64_t *bm)
+{
+	uint32_t key = 0;
+	int j;
+
+	for (j = 0; j < LCMATCH_LSH_BITS; j++)
+		key |= ((bm[pos[j] / 64] >> (pos[j] % 64)) & 1) << j;
+	return key;
+}
+
+static int lsh_slot_cmp(const void *a, const void *b)
+{
+	const struct lcmatch_lsh_slot *sa = a, *sb = b;
+
+	if (sa->key != sb->key)
+		return (sa->key < sb->key) ? -1 : 1;
+	return sa->id - sb->id;
+}
+
+/*
+ * sampling positions are picked among the bits which differ well over
+ * the library, estimated from a part of the entries.  most bits of the
+ * aligned patterns are the same (trailing 0s), and hashing them is useless.
+ */
+#define LSH_EST_ENT_MAX	1024
+
+static int lsh_pick_pool(const struct lcmatch_index *idx, int *pool)
+{
+	int n_bits = idx->n_words * 64;
+	int step = (idx->n_ent + LSH_EST_ENT_MAX - 1) / LSH_EST_ENT_MAX;
+	int n_est = 0;
+	int score_max = 0;
+	int *score;
+	int n_pool = 0;
+	int b, i;
+
+	if ((score = calloc(n_bits, sizeof(int))) == NULL) {
+		app_error("%s(): memory allocation failed.\n", __func__);
+		return -1;
+	}
+	for (i = 0; i < idx->n_ent; i += step ? step : 1, n_est++) {
+		const uint64_t *bm = &idx->bitmaps[(size_t)i * idx->n_words];
+		for (b = 0; b < n_bits; b++)
+			score[b] += (bm[b / 64] >> (b % 64)) & 1;
+	}
+	for (b = 0; b < n_bits; b++) {
+		if (score[b] > n_est - score[b])
+			score[b] = n_est - score[b];
+		if (score_max < score[b])
+			score_max = score[b];
+	}
+
+	for (b = 0; b < n_bits; b++) {
+		if (score[b] * 2 >= score_max)
+			pool[n_pool++] = b;
+	}
+
+	free(score);
+	return n_pool;
+}
+
+static int lsh_build(struct lcmatch_index *idx)
+{
+	uint32_t seed = 0x4c434d31;	/* fixed. reproducible buckets */
+	int *pool;
+	int n_pool;
+	int t, j, i;
+
+	if ((pool = malloc(sizeof(int) * idx->n_words * 64)) == NULL) {
+		app_error("%s(): memory allocation failed.\n", __func__);
+		return -1;
+	}
+	if ((n_pool = lsh_pick_pool(idx, pool)) <= 0) {
+		free(pool);
+		return -1;
+	}
+
+	for (t = 0; t < LCMATCH_LSH_TABLES; t++) {
+		struct lcmatch_lsh_slot *slots;
+
+		for (j = 0; j < LCMATCH_LSH_BITS; j++)
+			idx->lsh_pos[t][j] = pool[xorshift32(&seed) % n_pool];
+
+		slots = malloc(sizeof(*slots) * (idx->n_ent ? idx->n_ent : 1));
+		if (slots == NULL) {
+			app_error("%s(): memory allocation failed.\n",
+				  __func__);
+			free(pool);
+			return -1;
+		}
+		for (i = 0; i < idx->n_ent; i++) {
+			slots[i].key = lsh_key(idx->lsh_pos[t],
+				&idx->bitmaps[(size_t)i * idx->n_words]);
+			slots[i].id = i;
+		}
+		qsort(slots, idx->n_ent, sizeof(*slots), lsh_slot_cmp);
+		idx->lsh_slots[t] = slots;
+	}
+
+	free(pool);
+	return 0;
+}
+
+/*
+ * collect candidates which share a bucket with @bm in any table
+ * returns the number of candidates
+ */
+static int lsh_candidates(const struct lcmatch_index *idx, const uint64_t *bm,
+			  unsigned char *seen, int *cand)
+{
+	int n_cand = 0;
+	int t;
+
+	for (t = 0; t < LCMATCH_LSH_TABLES; t++) {
+		const struct lcmatch_lsh_slot *slots = idx->lsh_slots[t];
+		uint32_t key = lsh_key(idx->lsh_pos[t], bm);
+		int lo = 0, hi = idx->n_ent;
+
+		/* lower bound */
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (slots[mid].key < key)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		for (; (lo < idx->n_ent) && (slots[lo].key == key); lo++) {
+			if (!seen[slots[lo].id]) {
+				seen[slots[lo].id] = 1;
+				cand[n_cand++] = slots[lo].id;
+			}
+		}
+	}
+
+	return n_cand;
+}
+
+/*
+ * index
+ */
+int lcmatch_build(struct lcmatch_index *idx, struct lcdata *lcdata,
+		  int use_lsh)
+{
+	struct lcdata_ent ent;
+	void *p, *nextp, *endp;
+	size_t max_size = 0;
+	int i;
+
+	memset(idx, 0, sizeof(*idx));
+
+	lcdata_for_each_entry(lcdata, &ent, p, nextp, endp) {
+		if (!lcdata_ent_img_is_valid(p))
+			continue;
+		idx->n_ent++;
+		if (max_size < ent.data_size)
+			max_size = ent.data_size;
+	}
+	idx->n_words = (max_size * 8 + 63) / 64;
+	if (idx->n_words == 0)
+		idx->n_words = 1;
+
+	idx->tags = malloc(sizeof(char *) * (idx->n_ent ? idx->n_ent : 1));
+	idx->bitmaps = malloc(sizeof(uint64_t) * idx->n_words *
+			      (idx->n_ent ? idx->n_ent : 1));
+	if ((idx->tags == NULL) || (idx->bitmaps == NULL)) {
+		app_error("%s(): memory allocation failed.\n", __func__);
+		lcmatch_free(idx);
+		return -1;
+	}
+
+	i = 0;
+	lcdata_for_each_entry(lcdata, &ent, p, nextp, endp) {
+		unsigned char data[ent.data_size];
+
+		if (!lcdata_ent_img_is_valid(p))
+			continue;
+		lcdata_ent_expand(&ent, data);
+		idx->tags[i] = ent.tag;
+		align_bitmap(&idx->bitmaps[(size_t)i * idx->n_words],
+			     idx->n_words, data, ent.data_size);
+		i++;
+	}
+
+	idx->use_lsh = use_lsh;
+	if (use_lsh && (lsh_build(idx) < 0)) {
+		lcmatch_free(idx);
+		return -1;
+	}
+
+	return 0;
+}
+
+void lcmatch_free(struct lcmatch_index *idx)
+{
+	int t;
+
+	free(idx->tags);
+	free(idx->bitmaps);
+	for (t = 0; t < LCMATCH_LSH_TABLES; t++)
+		free(idx->lsh_slots[t]);
+	memset(idx, 0, sizeof(*idx));
+}
+
+static void topk_insert(struct lcmatch_result *res, int *n, int k,
+			const char *tag, int dist)
+{
+	int i;
+
+	if ((*n == k) && (res[k - 1].dist <= dist))
+		return;
+	for (i = (*n < k) ? (*n)++ : k - 1;
+	     (i > 0) && (res[i - 1].dist > dist); i--)
+		res[i] = res[i - 1];
+	res[i].tag = tag;
+	res[i].dist = dist;
+}
+
+/*
+ * find @k nearest entries of the pattern
+ * returns the number of results stored in @res (sorted by distance)
+ */
+int lcmatch_query(const struct lcmatch_index *idx,
+		  const unsigned char *data, size_t sz,
+		  struct lcmatch_result *res, int k)
+{
+	uint64_t bm[idx->n_words];
+	int n_res = 0;
+	int i;
+
+	if (k <= 0)
+		return 0;
+	align_bitmap(bm, idx->n_words, data, sz);
+
+	if (idx->use_lsh) {
+		unsigned char *seen = calloc(idx->n_ent ? idx->n_ent : 1, 1);
+		int *cand = malloc(sizeof(int) * (idx->n_ent ? idx->n_ent : 1));
+		int n_cand = 0;
+
+		if (seen && cand)
+			n_cand = lsh_candidates(idx, bm, seen, cand);
+		for (i = 0; i < n_cand; i++) {
+			const uint64_t *ebm =
+				&idx->bitmaps[(size_t)cand[i] * idx->n_words];
+			topk_insert(res, &n_res, k, idx->tags[cand[i]],
+				    hamming(bm, ebm, idx->n_words));
+		}
+		free(seen);
+		free(cand);
+		/* no candidates. fall back to the exhaustive search */
+		if (n_res > 0)
+			return n_res;
+	}
+
+	for (i = 0; i < idx->n_ent; i++) {
+		const uint64_t *ebm = &idx->bitmaps[(size_t)i * idx->n_words];
+		topk_insert(res, &n_res, k, idx->tags[i],
+			    hamming(bm, ebm, idx->n_words));
+	}
+
+	return n_res;
+}
@@ -0,0 +1,51 @@
+#ifndef _LEMON_CORN_MATCH_H
+#define _LEMON_CORN_MATCH_H
+
+#include <stdint.h>
+#include "lemon_corn_data.h"
+
+/*
+ * similarity index over the library
+ *
+ *   every entry is stored as a bitmap aligned to its first rising edge,
+ *   packed into 64 bit words.  the distance between two patterns is the
+ *   hamming distance of their aligned bitmaps.
+ *
+ *   with LSH enabled, candidates are prefiltered by bit sampling hash
+ *   tables, and only the candidates are compared.
+ */
+#define LCMATCH_LSH_TABLES	8
+#define LCMATCH_LSH_BITS	20
+
+struct lcmatch_lsh_slot {
+	uint32_t key;
+	int id;
+};
+
+struct lcmatch_index {
+	int n_ent;
+	int n_words;
+	const char **tags;
+	uint64_t *bitmaps;	/* n_ent * n_words */
+
+	/* LSH prefilter (optional) */
+	int use_lsh;
+	int lsh_pos[LCMATCH_LSH_TABLES][LCMATCH_LSH_BITS];
+	struct lcmatch_lsh_slot *lsh_slots[LCMATCH_LSH_TABLES];
+};
+
+struct lcmatch_result {
+	const char *tag;
+	int dist;
+};
+
+extern int
+lcmatch_build(struct lcmatch_index *idx, struct lcdata *lcdata, int use_lsh);
+extern void
+lcmatch_free(struct lcmatch_index *idx);
+extern int
+lcmatch_query(const struct lcmatch_index *idx,
+	      const unsigned char *data, size_t sz,
+	      struct lcmatch_result *res, int k);
+
+#endif	/* _LEMON_CORN_MATCH_H */
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <string.h>
+#include "format/format_util.h"
+#include "lemon_corn_rle.h"
+
+static inline size_t put_varint(unsigned char *p, unsigned long v)
+{
+	size_t n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (unsigned char)v;
+	return n;
+}
+
+/*
+ * returns the length of the next run from @idx with the value @val
+ */
+static size_t run_len(const unsigned char *data, size_t sz_bit, size_t idx,
+		      int val)
+{
+	unsigned char skip = val ? 0xff : 0x00;
+	size_t i = idx;
+
+	while (i < sz_bit) {
+		/* whole bytes at once */
+		if (!(i & 0x7) && (i + 8 <= sz_bit) && (data[i / 8] == skip)) {
+			i += 8;
+			continue;
+		}
+		if (get_bit_in_ary(data, i) != val)
+			break;
+		i++;
+	}
+	return i - idx;
+}
+
+/*
+ * encode @sz bytes of @data to @dst, and set the encoded length to @len.
+ * an all-low pattern is encoded to 0 bytes.
+ * returns 0 on success, -1 if it doesn't fit in @dst_sz
+ */
+int lcrle_encode(unsigned char *dst, size_t dst_sz,
+		 const unsigned char *data, size_t sz, size_t *len)
+{
+	size_t sz_bit = sz * 8;
+	size_t idx = 0, n = 0, last_n = 0;
+	int val = 0;
+
+	while (idx < sz_bit) {
+		size_t run = run_len(data, sz_bit, idx, val);
+
+		if (n + LCRLE_VARINT_LEN_MAX > dst_sz)
+			return -1;
+		n += put_varint(dst + n, run);
+		idx += run;
+		if (val)
+			last_n = n;
+		val = !val;
+	}
+
+	/* drop the trailing low */
+	*len = last_n;
+	return 0;
+}
+
+/*
+ * returns 0 on success, -1 on a broken varint.
+ * runs beyond @sz are dropped.
+ */
+int lcrle_decode(unsigned char *dst, size_t sz,
+		 const unsigned char *src, size_t len)
+{
+	const unsigned char *p = src, *endp = src + len;
+	size_t sz_bit = sz * 8;
+	size_t idx = 0;
+	unsigned long run;
+	int val = 0;
+
+	memset(dst, 0, sz);
+	while (p < endp) {
+		if (lcrle_get_run(&p, endp, &run) < 0)
+			return -1;
+		if (val && (idx < sz_bit))
+			set_bits_in_ary(dst, idx,
+					(idx + run < sz_bit) ? idx + run : sz_bit);
+		idx += run;
+		val = !val;
+	}
+	return 0;
+}
+
+/*
+ * read a run at @p, and advance @p
+ * returns 0 on success, -1 if the varint is broken or not complete
+ */
+int lcrle_get_run(const unsigned char **p, const unsigned char *endp,
+		  unsigned long *run)
+{
+	const unsigned char *q = *p;
+	unsigned long v = 0;
+	int sh;
+
+	for (sh = 0; q < endp; sh += 7) {
+		if (sh >= LCRLE_VARINT_LEN_MAX * 7)
+			return -1;
+		v |= (unsigned long)(*q & 0x7f) << sh;
+		if (!(*q++ & 0x80)) {
+			*p = q;
+			*run = v;
+			return 0;
+		}
+	}
+	return -1;
+}
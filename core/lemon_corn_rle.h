@@ -0,0 +1,27 @@
+#ifndef _LEMON_CORN_RLE_H
+#define _LEMON_CORN_RLE_H
+
+#include <stddef.h>
+
+/*
+ * run-length coding of the sample bitmaps
+ *
+ *   the pattern is a list of run lengths in samples (100us), alternating
+ *   between low and high and beginning with low (0 if the pattern begins
+ *   with high).  the low after the last high is omitted.
+ *   each run is a varint: 7 bits per byte from the least significant,
+ *   and the MSB is set on all bytes but the last.
+ */
+#define LCRLE_VARINT_LEN_MAX	5
+
+extern int
+lcrle_encode(unsigned char *dst, size_t dst_sz,
+	     const unsigned char *data, size_t sz, size_t *len);
+extern int
+lcrle_decode(unsigned char *dst, size_t sz,
+	     const unsigned char *src, size_t len);
+extern int
+lcrle_get_run(const unsigned char **p, const unsigned char *endp,
+	      unsigned long *run);
+
+#endif	/* _LEMON_CORN_RLE_H */
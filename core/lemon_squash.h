@@ -6,4 +6,122 @@
 
 #define LEMON_SQUASH_DATA_UNIT_LEN	16
 
+/*
+ * framed request (pipelined)
+ *
+ *   host -> device:
+ *     LEMON_SQUASH_CMD_FRAME, seq, op, ch, len[2], gap[2], data, sum
+ *       seq:  sequence number, returned with the ack
+ *       op:   LEMON_SQUASH_CMD_TRANSMIT2, LEMON_SQUASH_CMD_TRANSMIT_RLE,
+ *             or LEMON_SQUASH_CMD_TRANSMIT_IDX with the index as 1 byte data
+ *       ch:   PCOPRS1_CMD_CHANNEL(ch)
+ *       len:  the length of data in bytes (big endian)
+ *       gap:  idle time in ms after the signal (big endian)
+ *       sum:  8 bit sum of the bytes from seq to the end of data
+ *
+ *   device -> host:
+ *     LEMON_SQUASH_RESP_ACK, seq  (the signal and the gap are done)
+ *     LEMON_SQUASH_RESP_NAK, seq  (rejected. bad sum, no buffer, etc.)
+ *
+ *   the host can send up to LEMON_SQUASH_WINDOW frames without waiting
+ *   for the acks.  the device handles the frames in order.
+ */
+#define LEMON_SQUASH_CMD_FRAME		'f'
+#define LEMON_SQUASH_RESP_ACK		'A'
+#define LEMON_SQUASH_RESP_NAK		'N'
+
+#define LEMON_SQUASH_FRAME_HDR_LEN	8
+#define LEMON_SQUASH_WINDOW		4
+
+/*
+ * on-device library  (see lemon_corn_dlib.h for the image)
+ *
+ *   upload:
+ *     host -> device:  LEMON_SQUASH_CMD_UPLOAD, len[2]  (big endian)
+ *     device -> host:  PCOPRS1_CMD_OK  (LEMON_SQUASH_RESP_NAK if too big)
+ *     host -> device:  image
+ *     device -> host:  PCOPRS1_CMD_DATA_COMPLETION
+ *
+ *   transmit by index:
+ *     host -> device:  LEMON_SQUASH_CMD_TRANSMIT_IDX, index, ch
+ *     device -> host:  PCOPRS1_CMD_DATA_COMPLETION
+ *                      (LEMON_SQUASH_RESP_NAK for unknown index)
+ */
+#define LEMON_SQUASH_CMD_UPLOAD		'w'
+#define LEMON_SQUASH_CMD_TRANSMIT_IDX	'x'
+
+/*
+ * run-length coded transmit  (see lemon_corn_rle.h for the data)
+ *
+ *   same as LEMON_SQUASH_CMD_TRANSMIT2, but the length is 2 bytes in bytes
+ *     host -> device:  LEMON_SQUASH_CMD_TRANSMIT_RLE
+ *     device -> host:  PCOPRS1_CMD_OK
+ *     host -> device:  len[2]  (big endian)
+ *     device -> host:  PCOPRS1_CMD_OK
+ *     host -> device:  ch
+ *     device -> host:  PCOPRS1_CMD_OK
+ *     host -> device:  data
+ *     device -> host:  PCOPRS1_CMD_DATA_COMPLETION
+ */
+#define LEMON_SQUASH_CMD_TRANSMIT_RLE	'v'
+
+/*
+ * edge stream receive
+ *
+ *   host -> device:  LEMON_SQUASH_CMD_RECEIVE_EDGE
+ *   device -> host:  PCOPRS1_CMD_OK
+ *   device -> host:  PCOPRS1_CMD_RECEIVE_DATA  (at the first edge)
+ *   device -> host:  runs as they occur  (see lemon_corn_rle.h)
+ *                    the first low is 0.  the capture is closed after
+ *                    LEMON_SQUASH_EDGE_IDLE_MS of low, and the last low
+ *                    is followed by a 0 run.
+ *   device -> host:  PCOPRS1_CMD_DATA_COMPLETION
+ */
+#define LEMON_SQUASH_CMD_RECEIVE_EDGE	'g'
+#define LEMON_SQUASH_EDGE_IDLE_MS	150
+
+/*
+ * idle terminated receive
+ *
+ *   same as LEMON_SQUASH_CMD_RECEIVE2, but the capture is closed after
+ *   @idle ms of low following the last edge, and the actual length is sent
+ *     host -> device:  LEMON_SQUASH_CMD_RECEIVE_IDLE
+ *     device -> host:  PCOPRS1_CMD_OK
+ *     host -> device:  the max length in LEMON_SQUASH_DATA_UNIT_LEN
+ *     device -> host:  PCOPRS1_CMD_OK
+ *     host -> device:  idle  (ms, 1 - 255)
+ *     device -> host:  PCOPRS1_CMD_OK
+ *     device -> host:  PCOPRS1_CMD_RECEIVE_DATA  (at the first edge)
+ *     device -> host:  len[2]  (big endian. up to the max length)
+ *     device -> host:  data
+ *     device -> host:  PCOPRS1_CMD_DATA_COMPLETION
+ */
+#define LEMON_SQUASH_CMD_RECEIVE_IDLE	'e'
+
+/*
+ * link speed  (the link starts at 115200 baud)
+ *
+ *   query:
+ *     host -> device:  LEMON_SQUASH_CMD_BAUD, LEMON_SQUASH_BAUD_QUERY
+ *     device -> host:  PCOPRS1_CMD_OK, mask  (bit n: code n is supported)
+ *
+ *   switch:
+ *     host -> device:  LEMON_SQUASH_CMD_BAUD, code
+ *     device -> host:  PCOPRS1_CMD_OK  (at the current rate)
+ *     both ends switch to the new rate, and the host sends
+ *     PCOPRS1_CMD_LED to confirm.  the device gets back to 115200 baud
+ *     if it doesn't get the confirmation in LEMON_SQUASH_BAUD_REVERT_MS.
+ */
+#define LEMON_SQUASH_CMD_BAUD		'b'
+#define LEMON_SQUASH_BAUD_QUERY		'?'
+
+#define LEMON_SQUASH_BAUD_115200	0
+#define LEMON_SQUASH_BAUD_230400	1
+#define LEMON_SQUASH_BAUD_500000	2
+#define LEMON_SQUASH_BAUD_1000000	3
+#define LEMON_SQUASH_BAUD_2000000	4
+#define LEMON_SQUASH_BAUD_NUM		5
+
+#define LEMON_SQUASH_BAUD_REVERT_MS	500
+
 #endif /* _LEMON_SQUASH_H */
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lemon_corn_data.h"
+#include "lemon_corn_match.h"
+
+#define TEST_N_ENT		64
+#define TEST_DATA_LEN		48
+#define TEST_N_BITS		32
+#define TEST_K			5
+
+static void put_level(unsigned char *ptn, int *idx, int level, int len)
+{
+	for (; len > 0; len--, (*idx)++)
+		if (level)
+			ptn[*idx / 8] |= 1 << (*idx % 8);
+}
+
+/*
+ * @lead samples of low, then a pulse distance code distinct per @id
+ */
+static void forge(unsigned char *ptn, int id, int lead)
+{
+	unsigned int code = id * 0x9e3779b1u;
+	int idx = 0;
+	int i;
+
+	memset(ptn, 0, TEST_DATA_LEN);
+	put_level(ptn, &idx, 0, lead);
+	for (i = 0; i < TEST_N_BITS; i++) {
+		put_level(ptn, &idx, 1, 2);
+		put_level(ptn, &idx, 0, ((code >> i) & 1) ? 6 : 2);
+	}
+	put_level(ptn, &idx, 1, 2);
+}
+
+static size_t put_ent(void *p, int id)
+{
+	struct lcdata_ent_img_var *vent = p;
+
+	lcdata_ent_img_var_initialize(vent, TEST_DATA_LEN);
+	memset(vent->tag, 0, LEMON_CORN_TAG_LEN);
+	sprintf(vent->tag, "t%02d", id);
+	forge(vent->data, id, id % 5);
+	return sizeof(*vent) + TEST_DATA_LEN;
+}
+
+/*
+ * the best match must be @id at @dist, and the results sorted.
+ * with LSH, only the candidates come back, so there may be fewer.
+ */
+static int query(const struct lcmatch_index *idx, const char *what,
+		 const unsigned char *ptn, int id, int dist)
+{
+	struct lcmatch_result res[TEST_K];
+	char tag[LEMON_CORN_TAG_LEN];
+	int n, i;
+
+	sprintf(tag, "t%02d", id);
+	n = lcmatch_query(idx, ptn, TEST_DATA_LEN, res, TEST_K);
+	if ((n < 1) || (n > TEST_K) || (!idx->use_lsh && (n != TEST_K))) {
+		printf("%s: %d results\n", what, n);
+		return -1;
+	}
+	for (i = 1; i < n; i++) {
+		if (res[i - 1].dist > res[i].dist) {
+			printf("%s: not sorted at %d\n", what, i);
+			return -1;
+		}
+	}
+	if (strcmp(res[0].tag, tag) || (res[0].dist != dist)) {
+		printf("%s: got %s at %d, expected %s at %d\n",
+		       what, res[0].tag, res[0].dist, tag, dist);
+		return -1;
+	}
+	printf("%s: OK\n", what);
+	return 0;
+}
+
+static int run_test(struct lcdata *lcdata, int use_lsh)
+{
+	struct lcmatch_index idx;
+	struct lcmatch_result res[TEST_N_ENT + 1];
+	unsigned char ptn[TEST_DATA_LEN];
+	char what[64];
+	int id;
+	int r = 0;
+
+	if (lcmatch_build(&idx, lcdata, use_lsh) < 0) {
+		printf("%s: not built\n", use_lsh ? "lsh" : "exhaustive");
+		return -1;
+	}
+
+	/* the same pattern at another offset */
+	for (id = 0; id < TEST_N_ENT; id += 21) {
+		sprintf(what, "%s t%02d shifted",
+			use_lsh ? "lsh" : "exhaustive", id);
+		forge(ptn, id, 7);
+		if (query(&idx, what, ptn, id, 0) < 0)
+			r = -1;
+	}
+
+	/* 2 bits off in the trailing low */
+	sprintf(what, "%s t%02d 2 bits off",
+		use_lsh ? "lsh" : "exhaustive", 33);
+	forge(ptn, 33, 7);
+	ptn[TEST_DATA_LEN - 1] |= 0x11;
+	if (query(&idx, what, ptn, 33, 2) < 0)
+		r = -1;
+
+	/* fewer entries than asked */
+	if (!use_lsh &&
+	    (lcmatch_query(&idx, ptn, TEST_DATA_LEN, res, TEST_N_ENT + 1) !=
+	     TEST_N_ENT)) {
+		printf("exhaustive: not all the entries for k > %d\n",
+		       TEST_N_ENT);
+		r = -1;
+	}
+
+	lcmatch_free(&idx);
+	return r;
+}
+
+int main(void)
+{
+	struct lcdata lcdata = { .img_size = 0, .ent_img = NULL, .idx = NULL };
+	struct lcmatch_index idx;
+	struct lcmatch_result res[TEST_K];
+	unsigned char ptn[TEST_DATA_LEN];
+	int failed = 0;
+	int id, n;
+
+	lcdata.ent_img = malloc((sizeof(struct lcdata_ent_img_var) +
+				 TEST_DATA_LEN) * TEST_N_ENT);
+	if (lcdata.ent_img == NULL) {
+		printf("memory allocation failed.\n");
+		return 1;
+	}
+	for (id = 0; id < TEST_N_ENT; id++)
+		lcdata.img_size += put_ent(lcdata.ent_img + lcdata.img_size,
+					   id);
+
+	if (run_test(&lcdata, 0) < 0)
+		failed++;
+	if (run_test(&lcdata, 1) < 0)
+		failed++;
+
+	/* the deleted entries are not indexed */
+	lcdata_delete_by_tag(&lcdata, "t42");
+	if (lcmatch_build(&idx, &lcdata, 0) < 0) {
+		printf("deleted: not built\n");
+		failed++;
+	} else {
+		forge(ptn, 42, 0);
+		n = lcmatch_query(&idx, ptn, TEST_DATA_LEN, res, TEST_K);
+		if ((idx.n_ent != TEST_N_ENT - 1) ||
+		    ((n > 0) && !strcmp(res[0].tag, "t42"))) {
+			printf("deleted: t42 still indexed\n");
+			failed++;
+		} else {
+			printf("deleted: OK\n");
+		}
+		lcmatch_free(&idx);
+	}
+	lcdata_free(&lcdata);
+
+	return failed ? 1 : 0;
+}
@@ -28,6 +28,7 @@
 #include <errno.h>
 #include <termios.h>
 #include "PC-OP-RS1.h"
+#include "serial_util.h"
 
 #define DEBUG_HEAD_REMOCON_TEST		"[remocon-test] "
 #ifndef DEBUG_LEVEL_REMOCON_TEST
@@ -37,7 +38,7 @@
 
 #define ARRAY_SIZE(a)		(sizeof(a) / sizeof(a[0]))
 
-#define BAUDRATE		B115200
+#define IO_TIMEOUT_MS		2000
 
 static struct remocon_data {
 	char *tag;
@@ -85,6 +86,7 @@ static struct app {
 	char *cmd;
 	int ch;
 	int receive_mode;
+	int baud;
 } app;
 
 #if (DEBUG_LEVEL_REMOCON_TEST >= 1)
@@ -111,22 +113,20 @@ static int remocon_send(int fd, unsigned char *data, size_t sz)
 	return sz;
 }
 
+/*
+ * @timeout: ms. no limit if negative
+ */
 static int remocon_read(int fd, unsigned char *data, size_t sz,
-			unsigned long timeout)
+			int timeout)
 {
-	unsigned char *rp;
-	int rest, rcnt;
-
-	if (timeout == 0)
-		timeout = 10;
-
-	/* FIXME: timeout */
-	for (rp = data, rest = sz; rest; rp += rcnt, rest -= rcnt) {
-		rcnt = read(fd, rp, rest);
-		if (rcnt < 0) {
-			app_error("read error: %s\n", strerror(errno));
-			return rcnt;
-		}
+	int r;
+
+	r = serial_read_timeout(fd, data, sz, timeout);
+	if (r == 0) {
+		app_error("timed out waiting for the device\n");
+		return -1;
+	} else if (r < 0) {
+		return -1;
 	}
 
 #if (DEBUG_LEVEL_REMOCON_TEST >= 1)
@@ -143,7 +143,8 @@ static int remocon_expect(int fd, unsigned char expect)
 {
 	unsigned char c;
 
-	remocon_read(fd, &c, 1, -1);
+	if (remocon_read(fd, &c, 1, IO_TIMEOUT_MS) < 0)
+		return -1;
 	if (c != expect) {
 		app_error("expect 0x%02x, but got 0x%02x\n", expect, c);
 		return -1;
@@ -188,9 +189,14 @@ static int receive(int fd, unsigned char *data, size_t sz)
 		return -1;
 	if (remocon_expect(fd, PCOPRS1_CMD_OK) < 0)
 		return -1;
-	if (remocon_expect(fd, PCOPRS1_CMD_RECEIVE_DATA) < 0)
+	/* wait for the signal as long as it takes */
+	if ((remocon_read(fd, &c, 1, -1) < 0) ||
+	    (c != PCOPRS1_CMD_RECEIVE_DATA)) {
+		app_error("no receive data\n");
 		return -1;
-	if ((read_len = remocon_read(fd, data, PCOPRS1_DATA_LEN, -1)) < 0)
+	}
+	if ((read_len = remocon_read(fd, data, PCOPRS1_DATA_LEN,
+				     IO_TIMEOUT_MS)) < 0)
 		return -1;
 	if (remocon_expect(fd, PCOPRS1_CMD_DATA_COMPLETION) < 0)
 		return -1;
@@ -207,6 +213,7 @@ static void usage(const char *cmd_path)
 		"        -s <serial device> (default is /dev/ttyUSB)\n"
 		"        [-ch <channel>]\n"
 		"        [-r]\n"
+		"        [-baud <rate>]\n"
 		"        <command tag>\n"
 		"        [-h]\n",
 		basename(cpy_path));
@@ -230,6 +237,7 @@ static int parse_arg(int argc, char *argv[])
 	app.ch = 1;
 	app.receive_mode = 0;
 	app.cmd = NULL;
+	app.baud = SERIAL_BAUD_DEFAULT;
 
 	for (i = 1; i < argc; i++) {
 		if (!strcmp(argv[i], "-s")) {
@@ -240,6 +248,10 @@ static int parse_arg(int argc, char *argv[])
 			if (++i == argc)
 				return -1;
 			app.ch = atoi(argv[i]);
+		} else if (!strcmp(argv[i], "-baud")) {
+			if (++i == argc)
+				return -1;
+			app.baud = atoi(argv[i]);
 		} else if (!strcmp(argv[i], "-r")) {
 			app.receive_mode = 1;
 		} else if (!strcmp(argv[i], "-h")) {
@@ -269,7 +281,8 @@ static int parse_arg(int argc, char *argv[])
 int main(int argc, char **argv)
 {
 	int fd;
-	struct termios newtio, oldtio;
+	int baud;
+	struct termios oldtio;
 	unsigned char c;
 	unsigned char rbuf[PCOPRS1_DATA_LEN];
 	int i;
@@ -284,29 +297,17 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
-	fd = open(app.devname, O_RDWR | O_NOCTTY);
-	if (fd < 0) {
-		app_error("device open failed: %s (%s)\n",
-			  app.devname, strerror(errno));
+	if ((fd = serial_open(app.devname, &oldtio)) < 0)
 		return 1;
-	}
-
-	tcgetattr(fd,&oldtio);
-
-	newtio.c_cflag = BAUDRATE | CS8 | CLOCAL | CREAD;
-	newtio.c_iflag = 0;
-	newtio.c_oflag = 0;
-	newtio.c_lflag = 0;
-	newtio.c_cc[VMIN] = 1;
-	newtio.c_cc[VTIME] = 0;
-
-	tcflush(fd, TCIFLUSH);
-	tcsetattr(fd, TCSANOW, &newtio);
 
 	/* main */
 	c = PCOPRS1_CMD_LED;
-	remocon_send(fd, &c, 1);
-	remocon_expect(fd, PCOPRS1_CMD_LED_OK);
+	baud = SERIAL_BAUD_DEFAULT;
+	if ((remocon_send(fd, &c, 1) < 0) ||
+	    (remocon_expect(fd, PCOPRS1_CMD_LED_OK) < 0))
+		app_error("no answer from the device. keeping the speed\n");
+	else
+		baud = serial_negotiate(fd, app.baud);
 	if (app.receive_mode) {
 		r = receive(fd, rbuf, PCOPRS1_DATA_LEN);
 		for (i = 0; i < r; i++) {
@@ -326,8 +327,8 @@ int main(int argc, char **argv)
 	}
 
 out:
-	tcsetattr(fd, TCSANOW, &oldtio);
-	close(fd);
+	serial_restore_baud(fd, baud);
+	serial_close(fd, &oldtio);
 
 	return 0;
 }
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lemon_corn_rle.h"
+
+#define RUNS_MAX		8
+
+/*
+ * the patterns are given as runs alternating from low, or as a byte
+ * repeated over the whole pattern.  @dst_sz is the room the callers
+ * give, the size of the pattern.
+ */
+static struct rle_test {
+	const char *name;
+	size_t sz;		/* bytes of the pattern */
+	int runs[RUNS_MAX];
+	int n_runs;
+	unsigned char fill;
+	int fits;
+} rle_test[] = {
+	{ .name = "all low", .sz = 16, .n_runs = 0, .fits = 1 },
+	{ .name = "pulses", .sz = 16,
+	  .runs = { 3, 5, 7, 2, 1, 9 }, .n_runs = 6, .fits = 1 },
+	{ .name = "begins high", .sz = 16,
+	  .runs = { 0, 4, 6, 4 }, .n_runs = 4, .fits = 1 },
+	{ .name = "ends high", .sz = 8,
+	  .runs = { 40, 24 }, .n_runs = 2, .fits = 1 },
+	{ .name = "long runs", .sz = 240,
+	  .runs = { 90, 200, 1000, 300 }, .n_runs = 4, .fits = 1 },
+	{ .name = "doesn't fit", .sz = 16, .fill = 0x55, .fits = 0 },
+};
+
+static void put_level(unsigned char *ptn, int *idx, int level, int len)
+{
+	for (; len > 0; len--, (*idx)++)
+		if (level)
+			ptn[*idx / 8] |= 1 << (*idx % 8);
+}
+
+static int run_test(const struct rle_test *t)
+{
+	unsigned char *ptn, *rle, *dec;
+	size_t len;
+	int idx = 0;
+	int i;
+	int r = -1;
+
+	ptn = calloc(1, t->sz);
+	rle = malloc(t->sz);
+	dec = malloc(t->sz);
+	if ((ptn == NULL) || (rle == NULL) || (dec == NULL)) {
+		printf("%s: memory allocation failed.\n", t->name);
+		goto out;
+	}
+	if (t->fill)
+		memset(ptn, t->fill, t->sz);
+	for (i = 0; i < t->n_runs; i++)
+		put_level(ptn, &idx, i & 1, t->runs[i]);
+
+	if (lcrle_encode(rle, t->sz, ptn, t->sz, &len) < 0) {
+		if (t->fits) {
+			printf("%s: not encoded\n", t->name);
+			goto out;
+		}
+		printf("%s: OK (doesn't fit)\n", t->name);
+		r = 0;
+		goto out;
+	}
+	if (!t->fits) {
+		printf("%s: encoded to %zu bytes in %zu\n",
+		       t->name, len, t->sz);
+		goto out;
+	}
+	if (lcrle_decode(dec, t->sz, rle, len) < 0) {
+		printf("%s: not decoded\n", t->name);
+		goto out;
+	}
+	if (memcmp(ptn, dec, t->sz)) {
+		printf("%s: decoded pattern differs\n", t->name);
+		goto out;
+	}
+	printf("%s: OK (%zu -> %zu bytes)\n", t->name, t->sz, len);
+	r = 0;
+
+out:
+	free(ptn);
+	free(rle);
+	free(dec);
+	return r;
+}
+
+int main(void)
+{
+	unsigned int i;
+	int failed = 0;
+
+	for (i = 0; i < sizeof(rle_test) / sizeof(rle_test[0]); i++)
+		if (run_test(&rle_test[i]) < 0)
+			failed++;
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2012 Toshihiro Kobayashi <kobacha@mwa.biglobe.ne.jp>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include "PC-OP-RS1.h"
+#include "lemon_squash.h"
+#include "serial_util.h"
+
+#define DEBUG_HEAD_SERIAL_UTIL	"[serial_util] "
+#ifndef DEBUG_LEVEL_SERIAL_UTIL
+#define DEBUG_LEVEL_SERIAL_UTIL	0
+#endif
+#include "debug.h"
+
+#define SERIAL_NEGOTIATE_TIMEOUT_MS	200
+#define SERIAL_PROBE_TIMEOUT_MS		100
+#define SERIAL_DRAIN_MS			50
+
+static const struct {
+	int baud;
+	speed_t speed;
+} baud_table[LEMON_SQUASH_BAUD_NUM] = {
+	[LEMON_SQUASH_BAUD_115200]  = {  115200,  B115200 },
+	[LEMON_SQUASH_BAUD_230400]  = {  230400,  B230400 },
+	[LEMON_SQUASH_BAUD_500000]  = {  500000,  B500000 },
+	[LEMON_SQUASH_BAUD_1000000] = { 1000000, B1000000 },
+	[LEMON_SQUASH_BAUD_2000000] = { 2000000, B2000000 },
+};
+
+static speed_t baud_to_speed(int baud)
+{
+	int i;
+
+	for (i = 0; i < LEMON_SQUASH_BAUD_NUM; i++)
+		if (baud_table[i].baud == baud)
+			return baud_table[i].speed;
+	return B0;
+}
+
+/*
+ * open the device at SERIAL_BAUD_DEFAULT
+ */
+int serial_open(const char *devname, struct termios *tio_old)
+{
+	struct termios tio_new;
+	int fd;
+
+	fd = open(devname, O_RDWR | O_NOCTTY);
+	if (fd < 0) {
+		app_error("device open failed: %s (%s)\n",
+			  devname, strerror(errno));
+		return -1;
+	}
+
+	tcgetattr(fd, tio_old);
+
+	memset(&tio_new, 0, sizeof(tio_new));
+	tio_new.c_cflag = CS8 | CLOCAL | CREAD;
+	tio_new.c_iflag = 0;
+	tio_new.c_oflag = 0;
+	tio_new.c_lflag = 0;
+	tio_new.c_cc[VMIN] = 1;
+	tio_new.c_cc[VTIME] = 0;
+	cfsetispeed(&tio_new, baud_to_speed(SERIAL_BAUD_DEFAULT));
+	cfsetospeed(&tio_new, baud_to_speed(SERIAL_BAUD_DEFAULT));
+
+	tcflush(fd, TCIFLUSH);
+	tcsetattr(fd, TCSANOW, &tio_new);
+
+	return fd;
+}
+
+int serial_close(int fd, const struct termios *tio_old)
+{
+	tcsetattr(fd, TCSANOW, tio_old);
+	return close(fd);
+}
+
+int serial_set_baud(int fd, int baud)
+{
+	struct termios tio;
+	speed_t speed = baud_to_speed(baud);
+
+	if (speed == B0) {
+		app_error("unsupported baud rate %d\n", baud);
+		return -1;
+	}
+	if (tcgetattr(fd, &tio) < 0)
+		return -1;
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+	tcdrain(fd);
+	return tcsetattr(fd, TCSANOW, &tio);
+}
+
+static inline long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/*
+ * read @sz bytes in @timeout_ms (no limit if negative)
+ * returns @sz, 0 on timeout, or -1 on error.  a signal interrupts the
+ * read with -1 and errno EINTR.
+ */
+int serial_read_timeout(int fd, unsigned char *data, size_t sz,
+			int timeout_ms)
+{
+	long long deadline = now_ms() + timeout_ms;
+	size_t got = 0;
+
+	while (got < sz) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		long long rest = (timeout_ms < 0) ? -1 : deadline - now_ms();
+		ssize_t r;
+
+		if ((timeout_ms >= 0) && (rest <= 0))
+			return 0;
+		r = poll(&pfd, 1, rest);
+		if (r < 0) {
+			if (errno != EINTR)
+				app_error("poll error: %s\n", strerror(errno));
+			return -1;
+		}
+		if (r == 0)
+			continue;
+		r = read(fd, data + got, sz - got);
+		if (r < 0) {
+			if (errno != EINTR)
+				app_error("read error: %s\n", strerror(errno));
+			return -1;
+		}
+		if (r == 0) {
+			app_error("unexpected end of stream\n");
+			return -1;
+		}
+		got += r;
+	}
+	return sz;
+}
+
+static int send_cmd(int fd, unsigned char cmd, unsigned char arg)
+{
+	unsigned char buf[2] = { cmd, arg };
+
+	return (write(fd, buf, sizeof(buf)) == sizeof(buf)) ? 0 : -1;
+}
+
+/*
+ * check that the device talks at the current rate
+ */
+static int probe(int fd, int timeout_ms)
+{
+	unsigned char c = PCOPRS1_CMD_LED;
+
+	if (write(fd, &c, 1) != 1)
+		return -1;
+	if (serial_read_timeout(fd, &c, 1, timeout_ms) != 1)
+		return -1;
+	return ((c == PCOPRS1_CMD_LED_OK) || (c == PCOPRS1_CMD_OK)) ? 0 : -1;
+}
+
+/*
+ * probe the device until it answers, for @timeout_ms at most
+ * the answers to the earlier probes, which may come late, are dropped.
+ */
+int serial_wait_ready(int fd, int timeout_ms)
+{
+	long long deadline = now_ms() + timeout_ms;
+	unsigned char c;
+	int n_probe = 0;
+
+	while (probe(fd, SERIAL_PROBE_TIMEOUT_MS) < 0) {
+		if (now_ms() >= deadline) {
+			app_error("the device is not ready\n");
+			return -1;
+		}
+		n_probe++;
+	}
+	app_debug(SERIAL_UTIL, 1, "ready after %d probe(s)\n", n_probe + 1);
+
+	while (serial_read_timeout(fd, &c, 1, SERIAL_DRAIN_MS) == 1)
+		;
+	return 0;
+}
+
+/*
+ * keep DTR asserted on close, so that the next open doesn't reset the
+ * device (Arduino resets on the DTR edge)
+ */
+int serial_keep_dtr(int fd, struct termios *tio_old)
+{
+	struct termios tio;
+
+	if (tcgetattr(fd, &tio) < 0)
+		return -1;
+	tio.c_cflag &= ~HUPCL;
+	tio_old->c_cflag &= ~HUPCL;
+	return tcsetattr(fd, TCSANOW, &tio);
+}
+
+/*
+ * switch both ends to the fastest rate up to @baud_max supported by the
+ * device.  the device must be ready.
+ * returns the rate in effect.  SERIAL_BAUD_DEFAULT on any failure.
+ */
+int serial_negotiate(int fd, int baud_max)
+{
+	unsigned char resp[2];
+	int code;
+
+	if (baud_max <= SERIAL_BAUD_DEFAULT)
+		return SERIAL_BAUD_DEFAULT;
+
+	/* supported rates */
+	if ((send_cmd(fd, LEMON_SQUASH_CMD_BAUD, LEMON_SQUASH_BAUD_QUERY) < 0) ||
+	    (serial_read_timeout(fd, resp, 2,
+				 SERIAL_NEGOTIATE_TIMEOUT_MS) != 2) ||
+	    (resp[0] != PCOPRS1_CMD_OK)) {
+		app_error("the device doesn't change the baud rate\n");
+		goto fallback;
+	}
+	for (code = LEMON_SQUASH_BAUD_NUM - 1; code > 0; code--) {
+		if ((baud_table[code].baud <= baud_max) &&
+		    (resp[1] & (1 << code)))
+			break;
+	}
+	if (code == LEMON_SQUASH_BAUD_115200)
+		return SERIAL_BAUD_DEFAULT;
+
+	/* switch */
+	if ((send_cmd(fd, LEMON_SQUASH_CMD_BAUD, code) < 0) ||
+	    (serial_read_timeout(fd, resp, 1,
+				 SERIAL_NEGOTIATE_TIMEOUT_MS) != 1) ||
+	    (resp[0] != PCOPRS1_CMD_OK)) {
+		app_error("the device refused %d baud\n",
+			  baud_table[code].baud);
+		goto fallback;
+	}
+	if ((serial_set_baud(fd, baud_table[code].baud) == 0) &&
+	    (probe(fd, SERIAL_NEGOTIATE_TIMEOUT_MS) == 0)) {
+		app_debug(SERIAL_UTIL, 1, "switched to %d baud\n",
+			  baud_table[code].baud);
+		return baud_table[code].baud;
+	}
+
+	/* the device gets back to the default rate by itself */
+	app_error("no response at %d baud. falling back\n",
+		  baud_table[code].baud);
+	serial_set_baud(fd, SERIAL_BAUD_DEFAULT);
+	usleep(LEMON_SQUASH_BAUD_REVERT_MS * 1000);
+
+fallback:
+	tcflush(fd, TCIFLUSH);
+	return SERIAL_BAUD_DEFAULT;
+}
+
+/*
+ * switch both ends back to SERIAL_BAUD_DEFAULT from @baud, the rate
+ * serial_negotiate() returned, so that the next open finds the device
+ * at the default rate
+ */
+int serial_restore_baud(int fd, int baud)
+{
+	unsigned char resp;
+
+	if (baud == SERIAL_BAUD_DEFAULT)
+		return 0;
+
+	tcflush(fd, TCIFLUSH);
+	if ((send_cmd(fd, LEMON_SQUASH_CMD_BAUD,
+		      LEMON_SQUASH_BAUD_115200) < 0) ||
+	    (serial_read_timeout(fd, &resp, 1,
+				 SERIAL_NEGOTIATE_TIMEOUT_MS) != 1) ||
+	    (resp != PCOPRS1_CMD_OK)) {
+		app_error("the device doesn't get back to %d baud\n",
+			  SERIAL_BAUD_DEFAULT);
+		return -1;
+	}
+	serial_set_baud(fd, SERIAL_BAUD_DEFAULT);
+
+	/* the device gets back to the default rate without this as well */
+	if (probe(fd, SERIAL_NEGOTIATE_TIMEOUT_MS) < 0)
+		usleep(LEMON_SQUASH_BAUD_REVERT_MS * 1000);
+	app_debug(SERIAL_UTIL, 1, "switched back to %d baud\n",
+		  SERIAL_BAUD_DEFAULT);
+	return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef _SERIAL_UTIL_H
+#define _SERIAL_UTIL_H
+
+#include <stddef.h>
+#include <termios.h>
+
+#define SERIAL_BAUD_DEFAULT	115200
+
+extern int serial_open(const char *devname, struct termios *tio_old);
+extern int serial_close(int fd, const struct termios *tio_old);
+extern int serial_set_baud(int fd, int baud);
+extern int serial_read_timeout(int fd, unsigned char *data, size_t sz,
+			       int timeout_ms);
+extern int serial_wait_ready(int fd, int timeout_ms);
+extern int serial_keep_dtr(int fd, struct termios *tio_old);
+extern int serial_negotiate(int fd, int baud_max);
+extern int serial_restore_baud(int fd, int baud);
+
+#endif	/* _SERIAL_UTIL_H */
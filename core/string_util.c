@@ -12,3 +12,19 @@ char *strcatf(char *s, const char *form, ...)
 	va_end(pvar);
 	return s;
 }
+
+/*
+ * same as strcatf(), but @s is never filled beyond @size bytes
+ */
+char *strncatf(char *s, size_t size, const char *form, ...)
+{
+	size_t len = strlen(s);
+	va_list	pvar;
+
+	if (len + 1 >= size)
+		return s;
+	va_start(pvar, form);
+	vsnprintf(&s[len], size - len, form, pvar);
+	va_end(pvar);
+	return s;
+}
@@ -12,5 +12,6 @@ static inline char *strchomp(char *s)
 }
 
 extern char *strcatf(char *s, const char *form, ...);
+extern char *strncatf(char *s, size_t size, const char *form, ...);
 
 #endif	/* _STRING_UTIL_H */
@@ -14,10 +14,11 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include "serial_util.h"
 
 #define CMD_NAME	"serial_proxyd"
 #define PORT_STR	"26851"
-#define BAUDRATE	B115200
+#define ARDUINO_SETUP_WAIT_MS	3000
 
 #undef VERBOSE
 
@@ -29,6 +30,7 @@
 
 static struct {
 	const char *dev_name;
+	int baud;
 } app;
 
 struct server_fds {
@@ -84,39 +86,6 @@ static int daemonize(void)
 	return 0;
 }
 
-static int serial_open(const char *devname, struct termios *tio_old)
-{
-	struct termios tio_new;
-	int fd;
-
-	fd = open(devname, O_RDWR | O_NOCTTY);
-	if (fd < 0) {
-		fprintf(stderr, "device open failed: %s (%s)\n",
-			devname, strerror(errno));
-		return -1;
-	}
-
-	tcgetattr(fd, tio_old);
-
-	tio_new.c_cflag = BAUDRATE | CS8 | CLOCAL | CREAD;
-	tio_new.c_iflag = 0;
-	tio_new.c_oflag = 0;
-	tio_new.c_lflag = 0;
-	tio_new.c_cc[VMIN] = 1;
-	tio_new.c_cc[VTIME] = 0;
-
-	tcflush(fd, TCIFLUSH);
-	tcsetattr(fd, TCSANOW, &tio_new);
-
-	return fd;
-}
-
-static int serial_close(int fd, const struct termios *tio_old)
-{
-	tcsetattr(fd, TCSANOW, tio_old);
-	return close(fd);
-}
-
 static int server_open(void)
 {
 	int fd;
@@ -269,7 +238,8 @@ static void usage(const char *cmd_path)
 	fprintf(stderr,
 "usage : %s\n"
 "        -h                     :help\n"
-"        -s <serial devilce>    :specify serial device (default=/dev/ttyACM0)\n",
+"        -s <serial devilce>    :specify serial device (default=/dev/ttyACM0)\n"
+"        -baud <rate>           :switch to <rate> if the device supports it\n",
 		basename(cpy_path));
 	free(cpy_path);
 }
@@ -280,6 +250,7 @@ static int parse_arg(int argc, char **argv)
 
 	/* init */
 	app.dev_name = "/dev/ttyACM0";
+	app.baud = SERIAL_BAUD_DEFAULT;
 
 	for (i = 1; i < argc; i++) {
 		if (!strcmp(argv[i], "-h")) {
@@ -289,6 +260,10 @@ static int parse_arg(int argc, char **argv)
 			if (++i == argc)
 				goto err;
 			app.dev_name = argv[i];
+		} else if (!strcmp(argv[i], "-baud")) {
+			if (++i == argc)
+				goto err;
+			app.baud = atoi(argv[i]);
 		} else
 			goto err;
 	}
@@ -315,6 +290,11 @@ int main(int argc, char **argv)
 
 	if ((fds.fd_ser = serial_open(app.dev_name, &tio_old)) < 0)
 		return 1;
+	if (app.baud != SERIAL_BAUD_DEFAULT) {
+		/* the device resets on open */
+		if (serial_wait_ready(fds.fd_ser, ARDUINO_SETUP_WAIT_MS) == 0)
+			serial_negotiate(fds.fd_ser, app.baud);
+	}
 
 	if ((fds.fd_sock = server_open()) < 0)
 		return 1;